@@ -0,0 +1,51 @@
+pragma ComponentBehavior: Bound
+import QtQuick
+import QtQuick.Controls
+import QtQuick.Layouts
+
+Item {
+    id: page
+
+    ColumnLayout {
+        anchors.fill: parent
+        spacing: 12
+
+        RowLayout {
+            Layout.fillWidth: true
+            Button { text: "Back"; onClicked: page.StackView.view.pop() }
+            Label { text: "Backups"; font.pixelSize: 18 }
+            Item { Layout.fillWidth: true }
+            Button { text: "Back up now"; onClicked: App.backupNow() }
+        }
+
+        Label {
+            visible: App.backups.length === 0
+            text: "No snapshots yet."
+            opacity: 0.7
+        }
+
+        ListView {
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            spacing: 8
+            model: App.backups
+
+            delegate: Rectangle {
+                id: row
+                required property string modelData
+
+                width: ListView.view.width
+                height: 56
+                radius: 10
+                border.width: 1
+
+                RowLayout {
+                    anchors.fill: parent
+                    anchors.margins: 12
+                    Label { text: row.modelData; Layout.fillWidth: true }
+                    Button { text: "Restore"; onClicked: App.restoreBackup(row.modelData) }
+                }
+            }
+        }
+    }
+}
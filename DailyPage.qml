@@ -0,0 +1,55 @@
+pragma ComponentBehavior: Bound
+import QtQuick
+import QtQuick.Controls
+import QtQuick.Layouts
+
+Item {
+    id: page
+
+    Component.onCompleted: App.refreshDaily()
+
+    ColumnLayout {
+        anchors.fill: parent
+        spacing: 12
+
+        RowLayout {
+            Layout.fillWidth: true
+            Button { text: "Back"; onClicked: page.StackView.view.pop() }
+            Label { text: "Daily Tasks"; font.pixelSize: 18 }
+            Item { Layout.fillWidth: true }
+            Button { text: "Refresh"; onClicked: App.refreshDaily() }
+        }
+
+        ListView {
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            spacing: 10
+            model: App.dailyTasks
+
+            delegate: Rectangle {
+                id: row
+                required property dailyTask modelData
+
+                width: ListView.view.width
+                height: 64
+                radius: 12
+                border.width: 1
+
+                RowLayout {
+                    anchors.fill: parent
+                    anchors.margins: 12
+                    Label { text: row.modelData.title; Layout.fillWidth: true }
+                    Label { text: row.modelData.progress + "/" + row.modelData.target; opacity: 0.7 }
+                    Label { text: "+" + row.modelData.xp + " XP"; opacity: 0.7 }
+                    Label { text: "Done"; visible: row.modelData.done && !row.modelData.manual }
+                    Button {
+                        visible: row.modelData.manual
+                        text: row.modelData.done ? "Done" : "Complete"
+                        enabled: !row.modelData.done
+                        onClicked: App.completeDailyTask(row.modelData.id)
+                    }
+                }
+            }
+        }
+    }
+}
@@ -1,17 +1,152 @@
 #pragma once
 #include <QString>
+#include <QStringList>
 #include <QSqlDatabase>
+#include <functional>
+
+struct sqlite3;
+class QSqlError;
+class QDeadlineTimer;
 
 class Database {
 public:
+    enum QuestStatus { QuestLocked = 0, QuestUnlocked = 1, QuestCompleted = 2 };
+
+    static constexpr int kSchemaVersion = 9;   // bump with a new migration
+    static constexpr int kContentVersion = 1;  // bump when seed content changes
+
     static bool init();
     static QSqlDatabase db();
+    static QSqlDatabase threadDb();   // connection for the calling thread, until it ends
     static QString dbPath();
-    static bool initProgressForUser(int userId);
+    static QString archivePath();     // current cohort's cold attempts, attached as "archive"
+    static QString archivePath(const QString& cohort);
+    static bool initProgressForUser(QSqlDatabase db, int userId);
+    // User in the current cohort + progress + stats rows; -1 on failure.
+    // Commits as it goes; never inside an open transaction. db may be the
+    // main connection or a worker's threadDb().
+    static int createUser(QSqlDatabase db, const QString& username);
+    // Progress, stats and leaderboard rows of an existing user, for one
+    // whose creation was cut short. Cheap when nothing is missing.
+    static bool ensureUserRows(QSqlDatabase db, int userId);
+    // Undoes createUser() for a user nothing else was written for.
+    static bool dropNewUser(QSqlDatabase db, int userId);
+    // Copies a user's user_stats row to the cross-cohort leaderboard_agg.
+    static bool publishStats(QSqlDatabase db, int userId);
+
+    static qint64 now();       // epoch seconds, as stored in timestamp columns
+    static qint64 today();     // local Julian day, as stored in day columns
+    static qint64 sizeOnDisk();
+    static int currentStamp();   // user_version of an up-to-date file
+    // The driver's connection, or nullptr when the SQLite inside the Qt
+    // driver is not the build we link (see nativeApi()).
+    static sqlite3* handle(QSqlDatabase db);
+    // Whether the C API we link may be used on the driver's connections:
+    // same version, source id and compile options as the driver reports.
+    // Stock Qt bundles its own SQLite; then this is false.
+    static bool nativeApi();
+
+    // ---- Cohort shards ----
+    // Content, users and the cross-cohort leaderboard live in the shared
+    // file; a cohort's per-learner rows live in cohorts/cohort-<name>.sqlite.
+    // For a cohort the main connection opens that shard as "main" and
+    // attaches the shared file as "shared", so unqualified table names
+    // resolve to the right file and queries need not know about shards.
+    // Cohort "" is the shared file itself, home of learners without one.
+    //
+    // A transaction writing both files commits them one after the other
+    // (shard first), not as one. Rows that must not be lost or duplicated
+    // therefore never span files: users rows are created on their own
+    // before anything refers to them, and sync bookkeeping lives with the
+    // rows it describes. What may lag after a crash is derived data in the
+    // shared file: leaderboard_agg (republished by ensureUserRows()) and
+    // the question/quest counters (--rebuild-analytics, which sums every
+    // shard's history).
+    static QString currentCohort();
+    static QString cohortOf(QSqlDatabase db, int userId);   // "" if none
+    static bool isValidCohort(const QString& name);
+    static QString cohortPath(const QString& cohort);
+    // Every cohort with a shard file, by name; or with one in dir (a backup).
+    static QStringList cohorts(const QString& dir = QString());
+    // Runs work on a connection laid out for `cohort` (its shard as main,
+    // its archive, the shared file), whichever cohort is current: the
+    // thread's own connection for the current one, else a temporary one.
+    static bool withCohort(const QString& cohort, const std::function<bool(QSqlDatabase)>& work);
+    // Reopens the main connection on another cohort; worker connections
+    // follow on their next threadDb(). Main thread, no open transaction.
+    static bool useCohort(const QString& cohort);
+
+    // ---- Concurrent writers ----
+    // Several instances (or the app and a CLI run) may share the file. WAL
+    // lets readers proceed during a write; writers take the lock up front
+    // with BEGIN IMMEDIATE and back off and retry while another holds it,
+    // until a deadline for the whole unit.
+    //
+    // The GUI thread never sleeps for it: once setInteractive(true), its
+    // connection waits at most kInteractiveBusyMs inside SQLite, is not
+    // retried, and the caller reports lastWriteBusy() to the user. Long or
+    // bulk writes belong on a worker with threadDb().
+    static constexpr int kBusyTimeoutMs = 2000;      // SQLite's own wait per statement
+    static constexpr int kInteractiveBusyMs = 250;   // the same on the GUI thread
+    static constexpr int kWriteDeadlineMs = 10000;   // begin() or write(), retries included
+    static constexpr int kBackoffMs = 10;            // doubled per retry, jittered
+
+    struct Contention {
+        quint64 transactions = 0;
+        quint64 retries = 0;
+        quint64 failures = 0;
+        qint64 waitMs = 0;        // total time spent acquiring the write lock
+        qint64 maxWaitMs = 0;
+    };
+    static Contention contention();   // this process, since start
+    // Longest wait for the write lock in this process since the previous
+    // call. One caller measures a window with it (Backup::snapshot()).
+    static qint64 takePeakWaitMs();
+
+    // Main thread, once the UI is about to show; CLI runs stay patient.
+    static void setInteractive(bool on);
+    // Whether this thread's last begin()/write() gave up because another
+    // connection held the lock (as opposed to an error).
+    static bool lastWriteBusy();
+
+    // BEGIN IMMEDIATE, retried while another connection holds the lock.
+    // For long transactions that manage commit/rollback themselves.
+    static bool begin(QSqlDatabase db);
+    // Runs work between begin() and COMMIT. A busy failure anywhere inside
+    // rolls back and retries the whole unit within the same deadline; any
+    // other failure rolls back.
+    static bool write(QSqlDatabase db, const std::function<bool()>& work, const char* what);
 
 private:
     static QSqlDatabase s_db;
+    static void configure(QSqlDatabase db, const QString& cohort);
+    static QString mainPath();
+    static bool openCohort(const QString& cohort);
+    static bool prepareShard();
+    static bool checkNativeApi();
+    static bool isBusy(QSqlDatabase db, const QSqlError& error);
+    static bool isInteractive(QSqlDatabase db);
+    static int busyTimeoutMs(QSqlDatabase db);
+    static bool beginBy(QSqlDatabase db, const QDeadlineTimer& deadline);
+    static bool createHistoryView(QSqlDatabase db);
+    static int readStamp();
+    static bool writeStamp(int schema, int content);
     static bool createTables();
+    static bool createLegacyTables();
+    static bool tableExists(const QString& table);
+    static int schemaVersion();
+    static bool migrate();
+    static bool rebuildTable(const char* table, const QString& columns, const QString& select, bool shard = false);
+    static bool migrateToV2();
+    static bool migrateToV3();
+    static bool migrateToV4();
+    static bool migrateToV5();
+    static bool migrateToV6();
+    static bool migrateToV7();
+    static bool migrateToV8();
+    static bool migrateToV9();
+    static bool hasColumn(const QString& table, const QString& column);
+    static bool addColumnIfMissing(const QString& table, const QString& column, const QString& decl);
     static bool seedIfEmpty();
     static bool seedQuestionsIfEmpty();
     static bool seedLessonsIfEmpty();
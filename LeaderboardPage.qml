@@ -0,0 +1,51 @@
+pragma ComponentBehavior: Bound
+import QtQuick
+import QtQuick.Controls
+import QtQuick.Layouts
+
+Item {
+    id: page
+
+    Component.onCompleted: App.refreshLeaderboard()
+
+    ColumnLayout {
+        anchors.fill: parent
+        spacing: 12
+
+        RowLayout {
+            Layout.fillWidth: true
+            Button { text: "Back"; onClicked: page.StackView.view.pop() }
+            Label { text: "Leaderboard"; font.pixelSize: 18 }
+            Item { Layout.fillWidth: true }
+            Button { text: "Refresh"; onClicked: App.refreshLeaderboard() }
+        }
+
+        ListView {
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            spacing: 8
+            model: App.leaderboard
+
+            delegate: Rectangle {
+                id: row
+                required property leaderboardEntry modelData
+                required property int index
+
+                width: ListView.view.width
+                height: 56
+                radius: 10
+                border.width: 1
+
+                RowLayout {
+                    anchors.fill: parent
+                    anchors.margins: 12
+                    Label { text: (row.index + 1) + "."; width: 36 }
+                    Label { text: row.modelData.username; Layout.fillWidth: true }
+                    Label { text: "XP " + row.modelData.xp; opacity: 0.7 }
+                    Label { text: "Lv " + row.modelData.level; opacity: 0.7 }
+                    Label { text: "Score " + Math.round(row.modelData.score); opacity: 0.7 }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+pragma ComponentBehavior: Bound
+import QtQuick
+import QtQuick.Controls
+import QtQuick.Layouts
+
+ListView {
+    id: page
+
+    signal openQuest(questSummary quest)
+
+    // While another page is pushed on top, stop following App.quests;
+    // the model is re-read when this page becomes current again.
+    readonly property bool live: StackView.status === StackView.Active
+                                 || StackView.status === StackView.Activating
+
+    spacing: 10
+
+    Binding {
+        target: page
+        property: "model"
+        when: page.live
+        value: page.live ? App.quests : []
+        restoreMode: Binding.RestoreNone
+    }
+
+    delegate: Rectangle {
+        id: row
+        required property questSummary modelData
+
+        width: ListView.view.width
+        height: 72
+        radius: 12
+        border.width: 1
+
+        RowLayout {
+            anchors.fill: parent
+            anchors.margins: 12
+            spacing: 12
+
+            ColumnLayout {
+                Layout.fillWidth: true
+                Label { text: row.modelData.title; font.pixelSize: 16 }
+                Label { text: "Topic: " + row.modelData.topic + " | Difficulty: " + row.modelData.difficulty; opacity: 0.7 }
+            }
+
+            Label { text: row.modelData.status; opacity: 0.8 }
+
+            Button {
+                text: "Open"
+                enabled: row.modelData.status !== "locked"
+                onClicked: page.openQuest(row.modelData)
+            }
+        }
+    }
+}
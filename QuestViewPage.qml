@@ -0,0 +1,149 @@
+pragma ComponentBehavior: Bound
+import QtQuick
+import QtQuick.Controls
+import QtQuick.Layouts
+
+Item {
+    id: page
+
+    signal message(string text)
+
+    property questSummary quest
+    property question currentQ
+    property int selectedIndex: -1
+    property string lesson: ""
+
+    function loadQuestion() {
+        selectedIndex = -1
+        currentQ = App.getNextQuestion(quest.id)
+        if (!currentQ.valid) {
+            page.message("Quest mastered! ✅")
+        }
+    }
+
+    Component.onCompleted: {
+        lesson = App.getLesson(quest.id)
+        loadQuestion()
+    }
+
+    ColumnLayout {
+        anchors.fill: parent
+        spacing: 12
+
+        RowLayout {
+            Layout.fillWidth: true
+            Button { text: "Back"; onClicked: page.StackView.view.pop() }
+            Label { text: page.quest.title; font.pixelSize: 18 }
+            Item { Layout.fillWidth: true }
+            Label { text: page.quest.status; opacity: 0.8 }
+        }
+
+        Rectangle {
+            Layout.fillWidth: true
+            Layout.fillHeight: true
+            radius: 12
+            border.width: 1
+
+            ColumnLayout {
+                anchors.fill: parent
+                anchors.margins: 14
+                spacing: 12
+
+                // ====== QUIZ UI ======
+                ColumnLayout {
+                    Layout.fillWidth: true
+                    Layout.fillHeight: true
+                    spacing: 12
+                    visible: page.currentQ.valid
+
+                    Text {
+                        text: page.lesson
+                        textFormat: Text.MarkdownText
+                        wrapMode: Text.Wrap
+                        opacity: 0.85
+                    }
+
+
+                    Label {
+                        text: page.currentQ.prompt
+                        wrapMode: Text.Wrap
+                        font.pixelSize: 16
+                    }
+
+                    ColumnLayout {
+                        Layout.fillWidth: true
+                        spacing: 8
+
+                        Repeater {
+                            model: page.currentQ.choices
+
+                            delegate: RadioButton {
+                                id: choice
+                                required property string modelData
+                                required property int index
+
+                                Layout.fillWidth: true
+                                text: choice.modelData
+                                checked: choice.index === page.selectedIndex
+                                onClicked: page.selectedIndex = choice.index
+                            }
+                        }
+                    }
+
+                    Item { Layout.fillHeight: true }
+
+                    RowLayout {
+                        Layout.fillWidth: true
+
+                        Button { text: "Next"; onClicked: page.loadQuestion() }
+
+                        Item { Layout.fillWidth: true }
+
+                        Button {
+                            text: "Submit"
+                            enabled: page.currentQ.valid && page.selectedIndex !== -1
+                            onClicked: {
+                                var ok = App.submitAnswer(page.currentQ.id, page.selectedIndex)
+                                if (ok) page.loadQuestion()
+                            }
+                        }
+                    }
+                }
+
+                // ====== MASTERED UI ======
+                ColumnLayout {
+                    Layout.fillWidth: true
+                    Layout.fillHeight: true
+                    spacing: 12
+                    visible: !page.currentQ.valid
+
+                    Item { Layout.fillHeight: true }
+
+                    Label {
+                        text: "Quest mastered ✅"
+                        font.pixelSize: 18
+                        horizontalAlignment: Text.AlignHCenter
+                        Layout.fillWidth: true
+                    }
+
+                    Label {
+                        text: "You answered all questions correctly."
+                        opacity: 0.7
+                        horizontalAlignment: Text.AlignHCenter
+                        Layout.fillWidth: true
+                    }
+
+                    Item { Layout.fillHeight: true }
+
+                    RowLayout {
+                        Layout.alignment: Qt.AlignHCenter
+                        spacing: 12
+
+                        Button { text: "Back to quests"; onClicked: page.StackView.view.pop() }
+                        Button { text: "Refresh quests"; onClicked: App.refresh() }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,47 @@
+import QtQuick
+import QtQuick.Controls
+
+Popup {
+    id: snack
+    x: (parent.width - width) / 2
+    y: parent.height - height - 24
+    width: Math.min(parent.width * 0.9, 420)
+    height: implicitHeight
+    modal: false
+    focus: false
+    closePolicy: Popup.CloseOnEscape | Popup.CloseOnPressOutside
+
+    property string text: ""
+
+    background: Rectangle {
+        radius: 10
+        opacity: 0.92
+        border.width: 1
+    }
+
+    contentItem: Item {
+        implicitWidth: 420
+        implicitHeight: msg.implicitHeight + 24
+
+        Label {
+            id: msg
+            anchors.fill: parent
+            anchors.margins: 12
+            text: snack.text
+            wrapMode: Text.Wrap
+        }
+    }
+
+
+    Timer {
+        id: snackTimer
+        interval: 1800
+        onTriggered: snack.close()
+    }
+
+    function show(msg: string) {
+        snack.text = msg
+        snack.open()
+        snackTimer.restart()
+    }
+}
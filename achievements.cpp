@@ -0,0 +1,285 @@
+#include "achievements.h"
+#include "Database.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QVariantMap>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+enum Kind { CounterRule, TopicRule };
+
+struct Def {
+    const char *key;
+    const char *title;
+    Kind kind;
+    int counter;         // AchievementEngine::Counter for CounterRule
+    int threshold;
+    const char *topic;   // for TopicRule
+};
+
+// Bit i of achievement_state.unlocked is kDefs[i]; only append to this list.
+const Def kDefs[] = {
+    {"first_correct", "First correct answer",        CounterRule, 0, 1,  nullptr},
+    {"correct_10",    "10 correct answers in a row", CounterRule, 0, 10, nullptr},
+    {"streak_3",      "3-day streak",                CounterRule, 1, 3,  nullptr},
+    {"streak_7",      "7-day streak",                CounterRule, 1, 7,  nullptr},
+    {"level_5",       "Reached level 5",             CounterRule, 2, 5,  nullptr},
+    {"level_10",      "Reached level 10",            CounterRule, 2, 10, nullptr},
+    {"all_arrays",    "All array quests",            TopicRule,   0, 0,  "arrays"},
+    {"all_pointers",  "All pointer quests",          TopicRule,   0, 0,  "pointers"},
+    {"all_recursion", "All recursion quests",        TopicRule,   0, 0,  "recursion"},
+};
+constexpr int kDefCount = int(sizeof(kDefs) / sizeof(kDefs[0]));
+static_assert(kDefCount <= 64, "unlocked bitset is a single 64-bit column");
+
+} // namespace
+
+AchievementEngine::AchievementEngine(QObject *parent) : QObject(parent) {
+    for (int i = 0; i < kDefCount; ++i) {
+        if (kDefs[i].kind == CounterRule) m_byCounter[kDefs[i].counter].append(i);
+        else m_topicRule.insert(QString::fromLatin1(kDefs[i].topic), i);
+    }
+    for (auto &v : m_byCounter) {
+        std::sort(v.begin(), v.end(), [](int a, int b) { return kDefs[a].threshold < kDefs[b].threshold; });
+    }
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(5000);
+    connect(&m_flushTimer, &QTimer::timeout, this, &AchievementEngine::flush);
+}
+
+AchievementEngine::~AchievementEngine() {
+    flush();
+}
+
+bool AchievementEngine::testBit(const QByteArray &bits, int i) {
+    return i >= 0 && i / 8 < bits.size() && (uchar(bits[i / 8]) >> (i % 8)) & 1;
+}
+
+void AchievementEngine::setBit(QByteArray &bits, int i) {
+    if (i < 0) return;
+    if (i / 8 >= bits.size()) bits.append(QByteArray(i / 8 + 1 - bits.size(), '\0'));
+    bits[i / 8] = char(uchar(bits[i / 8]) | (1u << (i % 8)));
+}
+
+void AchievementEngine::loadContent() {
+    m_questTopic.clear();
+    m_topicTotal.clear();
+
+    QSqlQuery q(Database::db());
+    if (!q.exec("SELECT id, topic FROM quests")) {
+        qWarning() << q.lastError().text();
+        return;
+    }
+    while (q.next()) {
+        const QString topic = q.value(1).toString();
+        m_questTopic.insert(q.value(0).toInt(), topic);
+        ++m_topicTotal[topic];
+    }
+}
+
+void AchievementEngine::setUser(int userId, int level) {
+    flush();
+
+    m_userId = userId;
+    m_state = State{};
+    for (int &n : m_next) n = 0;
+    loadContent();
+
+    bool found = false;
+    {
+        QSqlQuery q(Database::db());
+        q.prepare(R"(
+            SELECT unlocked, correct_run, day_streak, last_day, quests_done
+            FROM achievement_state WHERE user_id = ?
+        )");
+        q.addBindValue(userId);
+        if (q.exec() && q.next()) {
+            found = true;
+            m_state.unlocked = q.value(0).toULongLong();
+            m_state.counters[CorrectRun] = q.value(1).toInt();
+            m_state.counters[DayStreak] = q.value(2).toInt();
+            m_state.lastDay = q.value(3).toLongLong();
+            m_state.questsDone = q.value(4).toByteArray();
+        }
+    }
+
+    // Fold in completed quests the bitset has not seen: first time for this
+    // user, or progress merged in from another machine.
+    bool changed = !found;
+    {
+        QSqlQuery q(Database::db());
+        q.prepare("SELECT quest_id FROM quest_progress WHERE user_id = ? AND status = ?");
+        q.addBindValue(userId);
+        q.addBindValue(int(Database::QuestCompleted));
+        if (q.exec()) {
+            while (q.next()) {
+                const int questId = q.value(0).toInt();
+                if (testBit(m_state.questsDone, questId)) continue;
+                setBit(m_state.questsDone, questId);
+                changed = true;
+            }
+        }
+    }
+    if (changed) markDirty();
+
+    m_topicDone.clear();
+    for (auto it = m_questTopic.cbegin(); it != m_questTopic.cend(); ++it) {
+        if (testBit(m_state.questsDone, it.key())) ++m_topicDone[it.value()];
+    }
+
+    // Skip thresholds already unlocked, then catch up silently on anything
+    // the stored state already satisfies (e.g. achievements added later).
+    for (int c = 0; c < CounterCount; ++c) {
+        const auto &rules = m_byCounter[c];
+        while (m_next[c] < rules.size() && (m_state.unlocked >> rules[m_next[c]]) & 1) ++m_next[c];
+    }
+    bump(CorrectRun, m_state.counters[CorrectRun], false);
+    bump(DayStreak, m_state.counters[DayStreak], false);
+    bump(Level, level, false);
+    for (auto it = m_topicRule.cbegin(); it != m_topicRule.cend(); ++it) {
+        const int total = m_topicTotal.value(it.key());
+        if (total > 0 && m_topicDone.value(it.key()) >= total) unlock(it.value(), false);
+    }
+}
+
+void AchievementEngine::bump(Counter c, int value, bool notify) {
+    if (m_state.counters[c] != value) {
+        m_state.counters[c] = value;
+        markDirty();
+    }
+
+    const auto &rules = m_byCounter[c];
+    while (m_next[c] < rules.size() && kDefs[rules[m_next[c]]].threshold <= value) {
+        unlock(rules[m_next[c]], notify);
+        ++m_next[c];
+    }
+}
+
+void AchievementEngine::unlock(int def, bool notify) {
+    const quint64 bit = quint64(1) << def;
+    if (m_state.unlocked & bit) return;
+
+    m_state.unlocked |= bit;
+    markDirty();
+    if (notify) emit unlocked(QString::fromUtf8(kDefs[def].title));
+}
+
+void AchievementEngine::onAnswer(bool correct) {
+    if (m_userId <= 0) return;
+    onActive();
+    bump(CorrectRun, correct ? m_state.counters[CorrectRun] + 1 : 0);
+}
+
+void AchievementEngine::onQuestCompleted(int questId) {
+    if (m_userId <= 0) return;
+    onActive();
+    if (testBit(m_state.questsDone, questId)) return;
+
+    setBit(m_state.questsDone, questId);
+    markDirty();
+
+    const QString topic = m_questTopic.value(questId);
+    if (topic.isEmpty()) return;
+
+    const int done = ++m_topicDone[topic];
+    const auto rule = m_topicRule.constFind(topic);
+    if (rule != m_topicRule.cend() && done >= m_topicTotal.value(topic)) unlock(rule.value(), true);
+}
+
+void AchievementEngine::onLevel(int level) {
+    if (m_userId <= 0) return;
+    bump(Level, level);
+}
+
+void AchievementEngine::onActive() {
+    if (m_userId <= 0) return;
+
+    const qint64 today = Database::today();
+    if (m_state.lastDay == today) return;
+
+    const int streak = (m_state.lastDay == today - 1) ? m_state.counters[DayStreak] + 1 : 1;
+    m_state.lastDay = today;
+    markDirty();
+    bump(DayStreak, streak);
+}
+
+QVariantList AchievementEngine::list() const {
+    QVariantList out;
+    for (int i = 0; i < kDefCount; ++i) {
+        QVariantMap m;
+        m["key"] = QString::fromLatin1(kDefs[i].key);
+        m["title"] = QString::fromUtf8(kDefs[i].title);
+        m["unlocked"] = bool((m_state.unlocked >> i) & 1);
+        out.append(m);
+    }
+    return out;
+}
+
+void AchievementEngine::markDirty() {
+    m_dirty = true;
+    if (!m_flushTimer.isActive()) m_flushTimer.start();
+}
+
+void AchievementEngine::flush() {
+    m_flushTimer.stop();
+    if (!m_dirty || m_userId <= 0) return;
+
+    // Another instance may hold the same learner and have flushed since we
+    // loaded: merge with its row instead of overwriting it. Unlocks and
+    // finished quests are unions, the run the longer one, the streak that
+    // of the later day.
+    QSqlDatabase db = Database::db();
+    const bool ok = Database::write(db, [&] {
+        State merged = m_state;
+        QSqlQuery q(db);
+        q.prepare(R"(
+            SELECT unlocked, correct_run, day_streak, last_day, quests_done
+            FROM achievement_state WHERE user_id = ?
+        )");
+        q.addBindValue(m_userId);
+        if (!q.exec()) {
+            qWarning() << "achievement flush failed:" << q.lastError().text();
+            return false;
+        }
+        if (q.next()) {
+            merged.unlocked |= q.value(0).toULongLong();
+            merged.counters[CorrectRun] = qMax(merged.counters[CorrectRun], q.value(1).toInt());
+            const int streak = q.value(2).toInt();
+            const qint64 day = q.value(3).toLongLong();
+            if (day > merged.lastDay) merged.counters[DayStreak] = streak;
+            else if (day == merged.lastDay) merged.counters[DayStreak] = qMax(merged.counters[DayStreak], streak);
+            merged.lastDay = qMax(merged.lastDay, day);
+            const QByteArray done = q.value(4).toByteArray();
+            if (merged.questsDone.size() < done.size()) merged.questsDone.resize(done.size(), '\0');
+            for (qsizetype b = 0; b < done.size(); ++b) merged.questsDone[b] = char(merged.questsDone[b] | done[b]);
+        }
+
+        q.prepare(R"(
+            INSERT INTO achievement_state(user_id, unlocked, correct_run, day_streak, last_day, quests_done)
+            VALUES(?, ?, ?, ?, ?, ?)
+            ON CONFLICT(user_id) DO UPDATE SET
+                unlocked=excluded.unlocked,
+                correct_run=excluded.correct_run,
+                day_streak=excluded.day_streak,
+                last_day=excluded.last_day,
+                quests_done=excluded.quests_done
+        )");
+        q.addBindValue(m_userId);
+        q.addBindValue(qint64(merged.unlocked));
+        q.addBindValue(merged.counters[CorrectRun]);
+        q.addBindValue(merged.counters[DayStreak]);
+        q.addBindValue(merged.lastDay);
+        q.addBindValue(merged.questsDone);
+        if (!q.exec()) {
+            qWarning() << "achievement flush failed:" << q.lastError().text();
+            return false;
+        }
+        return true;
+    }, "achievement flush");
+    // Kept dirty on failure: the next flush tries again.
+    if (ok) m_dirty = false;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QTimer>
+#include <QVariantList>
+#include <QVector>
+
+// Achievements evaluated incrementally over gameplay events.
+// Per-user rule state is a handful of counters plus two bitsets (unlocked
+// achievements, completed quests). Each event only looks at the next
+// unreached threshold of the rules it feeds, so cost per event does not
+// depend on history size or on how many achievements exist.
+// State is written back in batches, not per event.
+class AchievementEngine : public QObject {
+    Q_OBJECT
+public:
+    explicit AchievementEngine(QObject *parent = nullptr);
+    ~AchievementEngine() override;
+
+    void setUser(int userId, int level);
+
+    void onAnswer(bool correct);
+    void onQuestCompleted(int questId);
+    void onLevel(int level);
+    void onActive();                    // any gameplay action today
+
+    QVariantList list() const;          // [{key, title, unlocked}]
+
+    void flush();                       // persist pending state now
+
+signals:
+    void unlocked(QString title);
+
+private:
+    enum Counter { CorrectRun, DayStreak, Level, CounterCount };
+
+    struct State {
+        quint64 unlocked = 0;
+        int counters[CounterCount] = {0, 0, 1};
+        qint64 lastDay = 0;             // Julian day of last activity
+        QByteArray questsDone;          // bit per quest id
+    };
+
+    void loadContent();
+    void bump(Counter c, int value, bool notify = true);
+    void unlock(int def, bool notify);
+    void markDirty();
+
+    static bool testBit(const QByteArray &bits, int i);
+    static void setBit(QByteArray &bits, int i);
+
+    int m_userId = -1;
+    State m_state;
+    bool m_dirty = false;
+    QTimer m_flushTimer;
+
+    // Per counter: achievement indices sorted by threshold, and the first
+    // one not unlocked yet.
+    QVector<int> m_byCounter[CounterCount];
+    int m_next[CounterCount] = {0, 0, 0};
+
+    // Content (not history): quest topics and per-topic totals.
+    QHash<int, QString> m_questTopic;
+    QHash<QString, int> m_topicTotal;
+    QHash<QString, int> m_topicDone;
+    QHash<QString, int> m_topicRule;    // topic -> achievement index
+};
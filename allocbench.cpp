@@ -0,0 +1,299 @@
+#include "allocbench.h"
+#include "AppController.h"
+#include "Database.h"
+#include "dailytracker.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QDebug>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// ---- Counting allocator ----
+// On glibc the malloc family is interposed, which sees Qt's container and
+// string payloads as well as operator new. Elsewhere only operator new is
+// counted, which misses QArrayData (QString, QList) storage.
+
+namespace {
+
+std::atomic<quint64> g_allocs{0};
+std::atomic<quint64> g_bytes{0};
+
+void count(std::size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+} // namespace
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void *__libc_malloc(std::size_t n);
+void *__libc_calloc(std::size_t n, std::size_t size);
+void *__libc_realloc(void *p, std::size_t n);
+
+void *malloc(std::size_t n) noexcept {
+    count(n);
+    return __libc_malloc(n);
+}
+
+void *calloc(std::size_t n, std::size_t size) noexcept {
+    count(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, std::size_t n) noexcept {
+    count(n);
+    return __libc_realloc(p, n);
+}
+}
+
+#else
+
+void *operator new(std::size_t n) {
+    count(n);
+    if (void *p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t n) {
+    return ::operator new(n);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+#endif
+
+// ---- Before: the QVariantMap builders ----
+// As they were in appcontroller.cpp before the value types (51fd4f1^),
+// kept here verbatim so the comparison runs the code that shipped.
+
+namespace legacy {
+
+QString statusName(int status) {
+    switch (status) {
+    case Database::QuestUnlocked: return QStringLiteral("unlocked");
+    case Database::QuestCompleted: return QStringLiteral("completed");
+    default: return QStringLiteral("locked");
+    }
+}
+
+QVariantList queryQuests(QSqlDatabase db, int userId) {
+    QVariantList list;
+
+    QSqlQuery q(db);
+    q.prepare(R"(
+        SELECT q.id, q.title, q.topic, q.difficulty,
+               COALESCE(p.status, 0) as status,
+               COALESCE(p.best_score, 0) as best_score
+        FROM quests q
+        LEFT JOIN quest_progress p
+          ON p.quest_id = q.id AND p.user_id = ?
+        ORDER BY q.id ASC
+    )");
+    q.addBindValue(userId);
+
+    if (!q.exec()) {
+        qWarning() << q.lastError().text();
+        return list;
+    }
+
+    while (q.next()) {
+        QVariantMap m;
+        m["id"] = q.value(0).toInt();
+        m["title"] = q.value(1).toString();
+        m["topic"] = q.value(2).toString();
+        m["difficulty"] = q.value(3).toInt();
+        m["status"] = statusName(q.value(4).toInt());
+        m["bestScore"] = q.value(5).toInt();
+        list.append(m);
+    }
+    return list;
+}
+
+QVariantMap queryNextQuestion(QSqlDatabase db, int userId, int questId, int assumeMasteredId) {
+    QVariantMap out;
+
+    QSqlQuery q(db);
+    q.prepare(R"(
+        SELECT qu.id, qu.type, qu.prompt, qu.choices_json, qu.answer_json, qu.xp_value
+        FROM questions qu
+        LEFT JOIN attempt_summary s
+          ON s.user_id = ? AND s.question_id = qu.id
+        WHERE qu.quest_id = ?
+            AND qu.id != ?
+            AND COALESCE(s.correct, 0) = 0
+        ORDER BY qu.id ASC
+        LIMIT 1
+    )");
+    q.addBindValue(userId);
+    q.addBindValue(questId);
+    q.addBindValue(assumeMasteredId);
+
+    if (!q.exec()) {
+        qWarning() << "next question failed:" << q.lastError().text();
+        return out;
+    }
+
+    if (!q.next()) {
+        return out; // empty map
+    }
+
+    const int id = q.value(0).toInt();
+    const QString type = q.value(1).toString();
+    const QString prompt = q.value(2).toString();
+    const QString choicesStr = q.value(3).toString();
+    const int xp = q.value(5).toInt();
+
+    QVariantList choices;
+    {
+        const auto doc = QJsonDocument::fromJson(choicesStr.toUtf8());
+        if (doc.isArray()) {
+            for (auto v : doc.array()) choices.append(v.toVariant());
+        }
+    }
+
+    out["id"] = id;
+    out["type"] = type;
+    out["prompt"] = prompt;
+    out["choices"] = choices;
+    out["xp"] = xp;
+    return out;
+}
+
+QVariantList dailyRows(const QVector<DailyTracker::Task>& tasks) {
+    QVariantList out;
+
+    for (const auto &t : tasks) {
+        QVariantMap m;
+        m["id"] = t.id;
+        m["title"] = t.title;
+        m["xp"] = t.xp;
+        m["done"] = t.done;
+        m["manual"] = (t.action == DailyTracker::Manual);
+        m["progress"] = qMin(t.count, t.target);
+        m["target"] = t.target;
+        out.append(m);
+    }
+    return out;
+}
+
+QVariantList queryLeaderboard(QSqlDatabase db) {
+    QVariantList out;
+
+    QSqlQuery q(db);
+    q.prepare(R"(
+        SELECT u.username,
+               s.total_xp,
+               s.level,
+               s.last_active,
+               (s.total_xp +
+                 MAX(0, 200 - (? - COALESCE(s.last_active, 0)) / 86400.0 * 20)
+               ) AS rank_score
+        FROM leaderboard_agg s
+        JOIN users u ON u.id = s.user_id
+        ORDER BY rank_score DESC
+        LIMIT 20
+    )");
+    q.addBindValue(Database::now());
+    if (!q.exec()) {
+        qWarning() << "leaderboard failed:" << q.lastError().text();
+        return out;
+    }
+
+    while (q.next()) {
+        QVariantMap m;
+        m["username"] = q.value(0).toString();
+        m["xp"] = q.value(1).toInt();
+        m["level"] = q.value(2).toInt();
+        m["lastActive"] = q.value(3).isNull()
+            ? QString()
+            : QDateTime::fromSecsSinceEpoch(q.value(3).toLongLong()).toString(Qt::ISODate);
+        m["score"] = q.value(4).toDouble();
+        out.append(m);
+    }
+
+    return out;
+}
+
+} // namespace legacy
+
+// ---- Benchmark ----
+
+namespace {
+
+struct Count {
+    quint64 allocs = 0, bytes = 0;
+};
+
+template <typename F>
+Count counted(int rounds, F &&f) {
+    const quint64 allocs = g_allocs.load(), bytes = g_bytes.load();
+    for (int i = 0; i < rounds; ++i) {
+        const auto r = f();
+        Q_UNUSED(r);
+    }
+    return {(g_allocs.load() - allocs) / rounds, (g_bytes.load() - bytes) / rounds};
+}
+
+template <typename T> qsizetype rowCount(const QList<T> &rows) { return rows.size(); }
+template <typename T> qsizetype rowCount(const T &row) { return row.isValid() ? 1 : 0; }
+qsizetype rowCount(const QVariantMap &row) { return row.isEmpty() ? 0 : 1; }
+
+// Each path end to end, query included, as the controller ran it before
+// and runs it now.
+template <typename Before, typename After>
+void measure(const char *name, int rounds, Before &&before, After &&after) {
+    const qsizetype rows = rowCount(after());
+    const Count old = counted(rounds, before);
+    const Count now = counted(rounds, after);
+
+    qInfo().nospace() << name << ": " << rows << " rows, per call: before " << old.allocs << " allocs ("
+                      << old.bytes << " B), after " << now.allocs << " allocs (" << now.bytes << " B)";
+}
+
+int firstId(const char *sql) {
+    QSqlQuery q(Database::db());
+    if (!q.exec(QString::fromLatin1(sql)) || !q.next()) return -1;
+    return q.value(0).toInt();
+}
+
+} // namespace
+
+int AllocBench::run(int rounds) {
+    const int userId = firstId("SELECT id FROM users ORDER BY id LIMIT 1");
+    const int questId = firstId("SELECT id FROM quests ORDER BY id LIMIT 1");
+    if (rounds <= 0 || userId <= 0 || questId <= 0) {
+        qCritical() << "alloc bench: need a positive round count, a user and a quest";
+        return 1;
+    }
+    if (!Database::useCohort(Database::cohortOf(Database::db(), userId))) return 1;
+
+    QSqlDatabase db = Database::db();
+    DailyTracker dailies;
+    dailies.setUser(userId);
+
+    measure("quests", rounds,
+            [&] { return legacy::queryQuests(db, userId); },
+            [&] { return AppController::queryQuests(db, userId); });
+    measure("leaderboard", rounds,
+            [&] { return legacy::queryLeaderboard(db); },
+            [&] { return AppController::queryLeaderboard(db); });
+    measure("daily tasks", rounds,
+            [&] { return legacy::dailyRows(dailies.tasks()); },
+            [&] { return AppController::dailyRows(dailies.tasks()); });
+    measure("next question", rounds,
+            [&] { return legacy::queryNextQuestion(db, userId, questId, -1); },
+            [&] { return AppController::queryNextQuestion(db, userId, questId, -1); });
+    return 0;
+}
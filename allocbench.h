@@ -0,0 +1,14 @@
+#pragma once
+
+// Heap allocations per call of the model refresh paths (quests, leaderboard,
+// daily tasks, next question): the QVariantMap builders as they shipped
+// before the value types, against the typed ones QML gets now, each end to
+// end on the same data. Only built with CODELEVELING_ALLOC_BENCH, which
+// also swaps in a counting allocator.
+class AllocBench {
+public:
+    static constexpr int kRounds = 1000;
+
+    // Prints one line per path; returns an exit code.
+    static int run(int rounds = kRounds);
+};
@@ -0,0 +1,479 @@
+#include "analytics.h"
+#include "Database.h"
+#include <QDataStream>
+#include <QDir>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QTextStream>
+#include <QVariant>
+#include <QVariantMap>
+#include <QDebug>
+#include <iterator>
+
+namespace {
+
+constexpr int kMinLearners = 10;           // below this, rates are noise
+constexpr double kSuspectFirstTry = 0.25;
+constexpr int kMaxChoices = 64;            // ignore nonsense indices in reports
+
+bool exec(QSqlQuery& q, const char* what) {
+    if (q.exec()) return true;
+    qWarning() << "analytics:" << what << "failed:" << q.lastError().text();
+    return false;
+}
+
+bool bumpQuestion(QSqlDatabase db, int questionId, qint64 attempts, qint64 correct, int learners,
+                  int firstTry, int mastered, qint64 attemptsToMastery) {
+    QSqlQuery q(db);
+    q.prepare(R"(
+        INSERT INTO question_stats(question_id, attempts, correct, learners, first_try_correct, mastered, attempts_to_mastery)
+        VALUES(?, ?, ?, ?, ?, ?, ?)
+        ON CONFLICT(question_id) DO UPDATE SET
+            attempts = attempts + excluded.attempts,
+            correct = correct + excluded.correct,
+            learners = learners + excluded.learners,
+            first_try_correct = first_try_correct + excluded.first_try_correct,
+            mastered = mastered + excluded.mastered,
+            attempts_to_mastery = attempts_to_mastery + excluded.attempts_to_mastery
+    )");
+    q.addBindValue(questionId);
+    q.addBindValue(attempts);
+    q.addBindValue(correct);
+    q.addBindValue(learners);
+    q.addBindValue(firstTry);
+    q.addBindValue(mastered);
+    q.addBindValue(attemptsToMastery);
+    return exec(q, "question stats");
+}
+
+bool bumpFunnel(QSqlDatabase db, int questId, int started, int completed) {
+    QSqlQuery q(db);
+    q.prepare(R"(
+        INSERT INTO quest_funnel(quest_id, started, completed) VALUES(?, ?, ?)
+        ON CONFLICT(quest_id) DO UPDATE SET
+            started = started + excluded.started,
+            completed = completed + excluded.completed
+    )");
+    q.addBindValue(questId);
+    q.addBindValue(started);
+    q.addBindValue(completed);
+    return exec(q, "quest funnel");
+}
+
+double ratio(qint64 num, qint64 den) { return den > 0 ? double(num) / double(den) : 0.0; }
+
+} // namespace
+
+// ---- Recording ----
+
+bool Analytics::recordAttempt(QSqlDatabase db, const Attempt& a, bool* wasMastered) {
+    qint64 prevAttempts = 0, prevCorrect = 0;
+    {
+        QSqlQuery q(db);
+        q.prepare("SELECT attempts, correct FROM attempt_summary WHERE user_id = ? AND question_id = ?");
+        q.addBindValue(a.userId);
+        q.addBindValue(a.questionId);
+        if (!exec(q, "summary lookup")) return false;
+        if (q.next()) {
+            prevAttempts = q.value(0).toLongLong();
+            prevCorrect = q.value(1).toLongLong();
+        }
+    }
+    if (wasMastered) *wasMastered = prevCorrect > 0;
+
+    // A learner's first attempt at any question of a quest starts that quest.
+    int startedQuest = -1;
+    if (prevAttempts == 0) {
+        QSqlQuery q(db);
+        q.prepare(R"(
+            SELECT qu.quest_id,
+                   EXISTS(SELECT 1 FROM attempt_summary s
+                          JOIN questions o ON o.id = s.question_id
+                          WHERE s.user_id = ? AND o.quest_id = qu.quest_id)
+            FROM questions qu WHERE qu.id = ?
+        )");
+        q.addBindValue(a.userId);
+        q.addBindValue(a.questionId);
+        if (!exec(q, "quest lookup")) return false;
+        if (q.next() && q.value(1).toInt() == 0) startedQuest = q.value(0).toInt();
+    }
+
+    QSqlQuery ins(db);
+    ins.prepare(R"(
+        INSERT INTO attempts(user_id, question_id, timestamp, is_correct, answer, origin)
+        VALUES(?, ?, ?, ?, ?, ?)
+    )");
+    ins.addBindValue(a.userId);
+    ins.addBindValue(a.questionId);
+    ins.addBindValue(a.timestamp);
+    ins.addBindValue(a.correct ? 1 : 0);
+    ins.addBindValue(a.answer);
+    ins.addBindValue(a.origin);
+
+    QSqlQuery sum(db);
+    sum.prepare(R"(
+        INSERT INTO attempt_summary(user_id, question_id, attempts, correct, first_ts, last_ts)
+        VALUES(?, ?, 1, ?, ?, ?)
+        ON CONFLICT(user_id, question_id) DO UPDATE SET
+            attempts = attempts + 1,
+            correct = correct + excluded.correct,
+            first_ts = MIN(first_ts, excluded.first_ts),
+            last_ts = MAX(last_ts, excluded.last_ts)
+    )");
+    sum.addBindValue(a.userId);
+    sum.addBindValue(a.questionId);
+    sum.addBindValue(a.correct ? 1 : 0);
+    sum.addBindValue(a.timestamp);
+    sum.addBindValue(a.timestamp);
+
+    const bool firstTry = prevAttempts == 0;
+    const bool masters = a.correct && prevCorrect == 0;
+
+    return exec(ins, "attempt insert")
+        && exec(sum, "summary update")
+        && bumpQuestion(db, a.questionId, 1, a.correct ? 1 : 0, firstTry ? 1 : 0,
+                        firstTry && a.correct ? 1 : 0, masters ? 1 : 0, masters ? prevAttempts + 1 : 0)
+        && addPicks(db, a.questionId, a.answer, 1)
+        && (startedQuest < 0 || questStarted(db, startedQuest));
+}
+
+bool Analytics::questCompleted(QSqlDatabase db, int questId) {
+    return bumpFunnel(db, questId, 0, 1);
+}
+
+bool Analytics::questStarted(QSqlDatabase db, int questId) {
+    return bumpFunnel(db, questId, 1, 0);
+}
+
+bool Analytics::questsStartedBy(QSqlDatabase db, int userId) {
+    QSqlQuery q(db);
+    q.prepare(R"(
+        INSERT INTO quest_funnel(quest_id, started, completed)
+        SELECT DISTINCT qu.quest_id, 1, 0
+        FROM attempt_summary s JOIN questions qu ON qu.id = s.question_id
+        WHERE s.user_id = ?
+        ON CONFLICT(quest_id) DO UPDATE SET started = started + 1
+    )");
+    q.addBindValue(userId);
+    return exec(q, "quests started");
+}
+
+bool Analytics::addLearner(QSqlDatabase db, int questionId, const QuestionDelta& d) {
+    const bool mastered = d.attemptsToMastery > 0;
+    return bumpQuestion(db, questionId, d.attempts, d.correct, 1, d.firstTryCorrect ? 1 : 0,
+                        mastered ? 1 : 0, d.attemptsToMastery);
+}
+
+bool Analytics::addPicks(QSqlDatabase db, int questionId, int answer, qint64 picks) {
+    if (answer < 0) return true;   // no selection recorded (legacy rows)
+
+    QSqlQuery q(db);
+    q.prepare(R"(
+        INSERT INTO question_picks(question_id, choice, picks) VALUES(?, ?, ?)
+        ON CONFLICT(question_id, choice) DO UPDATE SET picks = picks + excluded.picks
+    )");
+    q.addBindValue(questionId);
+    q.addBindValue(answer);
+    q.addBindValue(picks);
+    return exec(q, "picks");
+}
+
+// ---- Reports ----
+
+QVariantList Analytics::questionReport(QSqlDatabase db, int questId) {
+    QVariantList out;
+
+    QHash<int, QVariantList> picks;
+    {
+        QSqlQuery q(db);
+        q.prepare(R"(
+            SELECT p.question_id, p.choice, p.picks
+            FROM question_picks p JOIN questions qu ON qu.id = p.question_id
+            WHERE ? < 0 OR qu.quest_id = ?
+            ORDER BY p.question_id, p.choice
+        )");
+        q.addBindValue(questId);
+        q.addBindValue(questId);
+        if (!exec(q, "picks report")) return out;
+        while (q.next()) {
+            QVariantList &list = picks[q.value(0).toInt()];
+            const int choice = q.value(1).toInt();
+            if (choice < 0 || choice > kMaxChoices) continue;
+            while (list.size() <= choice) list.append(0);
+            list[choice] = q.value(2).toLongLong();
+        }
+    }
+
+    QSqlQuery q(db);
+    q.prepare(R"(
+        SELECT qu.id, qu.quest_id, qu.prompt, qu.answer_json,
+               COALESCE(s.attempts, 0), COALESCE(s.correct, 0), COALESCE(s.learners, 0),
+               COALESCE(s.first_try_correct, 0), COALESCE(s.mastered, 0), COALESCE(s.attempts_to_mastery, 0)
+        FROM questions qu
+        LEFT JOIN question_stats s ON s.question_id = qu.id
+        WHERE ? < 0 OR qu.quest_id = ?
+        ORDER BY qu.quest_id, qu.id
+    )");
+    q.addBindValue(questId);
+    q.addBindValue(questId);
+    if (!exec(q, "question report")) return out;
+
+    while (q.next()) {
+        const int id = q.value(0).toInt();
+        const qint64 attempts = q.value(4).toLongLong();
+        const qint64 learners = q.value(6).toLongLong();
+        const double firstTry = ratio(q.value(7).toLongLong(), learners);
+        const QVariantList choicePicks = picks.value(id);
+
+        // A distractor chosen more often than the key usually means a wrong
+        // key or a misleading prompt.
+        const int correctIndex = QJsonDocument::fromJson(q.value(3).toString().toUtf8())
+                                     .object().value("correctIndex").toInt(-1);
+        const qint64 correctPicks = correctIndex >= 0 ? choicePicks.value(correctIndex).toLongLong() : 0;
+        bool distractorWins = false;
+        for (int i = 0; i < choicePicks.size(); ++i)
+            if (i != correctIndex && choicePicks[i].toLongLong() > correctPicks) distractorWins = true;
+
+        QVariantMap m;
+        m["questionId"] = id;
+        m["questId"] = q.value(1).toInt();
+        m["prompt"] = q.value(2).toString();
+        m["attempts"] = attempts;
+        m["learners"] = learners;
+        m["correctRate"] = ratio(q.value(5).toLongLong(), attempts);
+        m["firstTryRate"] = firstTry;
+        m["meanAttemptsToMastery"] = ratio(q.value(9).toLongLong(), q.value(8).toLongLong());
+        m["picks"] = choicePicks;
+        m["suspect"] = learners >= kMinLearners && (firstTry < kSuspectFirstTry || distractorWins);
+        out.append(m);
+    }
+    return out;
+}
+
+QVariantList Analytics::questFunnel(QSqlDatabase db) {
+    QVariantList out;
+
+    QHash<int, QVariantList> steps;
+    {
+        QSqlQuery q(db);
+        if (!q.exec(R"(
+            SELECT qu.quest_id, COALESCE(s.learners, 0)
+            FROM questions qu LEFT JOIN question_stats s ON s.question_id = qu.id
+            ORDER BY qu.quest_id, qu.id
+        )")) {
+            qWarning() << "analytics: funnel steps failed:" << q.lastError().text();
+            return out;
+        }
+        while (q.next()) steps[q.value(0).toInt()].append(q.value(1).toLongLong());
+    }
+
+    QSqlQuery q(db);
+    if (!q.exec(R"(
+        SELECT qs.id, qs.title, COALESCE(f.started, 0), COALESCE(f.completed, 0)
+        FROM quests qs LEFT JOIN quest_funnel f ON f.quest_id = qs.id
+        ORDER BY qs.id
+    )")) {
+        qWarning() << "analytics: funnel failed:" << q.lastError().text();
+        return out;
+    }
+    while (q.next()) {
+        QVariantMap m;
+        m["questId"] = q.value(0).toInt();
+        m["title"] = q.value(1).toString();
+        m["started"] = q.value(2).toLongLong();
+        m["completed"] = q.value(3).toLongLong();
+        m["steps"] = steps.value(q.value(0).toInt());
+        out.append(m);
+    }
+    return out;
+}
+
+// ---- Export ----
+
+bool Analytics::exportTo(QSqlDatabase db, const QString& dir, QString* error) {
+    // types: one letter per column, i = integer, r = real, t = text
+    struct Table { const char* name; const char* types; const char* sql; };
+    static const Table tables[] = {
+        {"question_stats", "iiiiiiiirr", R"(
+            SELECT qu.id AS question_id, qu.quest_id,
+                   COALESCE(s.attempts, 0) AS attempts, COALESCE(s.correct, 0) AS correct,
+                   COALESCE(s.learners, 0) AS learners, COALESCE(s.first_try_correct, 0) AS first_try_correct,
+                   COALESCE(s.mastered, 0) AS mastered, COALESCE(s.attempts_to_mastery, 0) AS attempts_to_mastery,
+                   CAST(s.first_try_correct AS REAL) / NULLIF(s.learners, 0) AS first_try_rate,
+                   CAST(s.attempts_to_mastery AS REAL) / NULLIF(s.mastered, 0) AS mean_attempts_to_mastery
+            FROM questions qu LEFT JOIN question_stats s ON s.question_id = qu.id
+            ORDER BY qu.quest_id, qu.id
+        )"},
+        {"question_picks", "iii", "SELECT question_id, choice, picks FROM question_picks ORDER BY question_id, choice"},
+        {"quest_funnel", "itii", R"(
+            SELECT qs.id AS quest_id, qs.title,
+                   COALESCE(f.started, 0) AS started, COALESCE(f.completed, 0) AS completed
+            FROM quests qs LEFT JOIN quest_funnel f ON f.quest_id = qs.id
+            ORDER BY qs.id
+        )"},
+    };
+
+    auto fail = [error](const QString& msg) {
+        qWarning() << "analytics export failed:" << msg;
+        if (error) *error = msg;
+        return false;
+    };
+    if (!QDir().mkpath(dir)) return fail("cannot create " + dir);
+
+    // Columnar file: per table its name, row count and columns; per column
+    // its name, a type tag and one qCompress'd block of values.
+    enum ColumnType : quint8 { Int64 = 0, Real = 1, Text = 2 };
+    QSaveFile columnar(QDir(dir).filePath("analytics.clcol"));
+    if (!columnar.open(QIODevice::WriteOnly)) return fail(columnar.errorString());
+    QDataStream col(&columnar);
+    col.setVersion(QDataStream::Qt_6_5);
+    col << quint32(0x434c434f) << quint16(1) << quint32(std::size(tables));   // "CLCO"
+
+    for (const auto &t : tables) {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        if (!q.exec(QString::fromLatin1(t.sql))) return fail(q.lastError().text());
+
+        QSaveFile csv(QDir(dir).filePath(QString::fromLatin1(t.name) + ".csv"));
+        if (!csv.open(QIODevice::WriteOnly | QIODevice::Text)) return fail(csv.errorString());
+        QTextStream out(&csv);
+
+        const QSqlRecord rec = q.record();
+        const int n = rec.count();
+        QStringList header;
+        for (int i = 0; i < n; ++i) header << rec.fieldName(i);
+        out << header.join(',') << '\n';
+
+        // Stats tables have one row per question or quest, so columns fit in memory.
+        QList<QByteArray> blocks(n);
+        QList<QDataStream*> streams;
+        QList<ColumnType> types(n, Int64);
+        for (int i = 0; i < n; ++i) {
+            streams.append(new QDataStream(&blocks[i], QIODevice::WriteOnly));
+            streams.last()->setVersion(QDataStream::Qt_6_5);
+            const char type = i < int(qstrlen(t.types)) ? t.types[i] : 'i';
+            types[i] = type == 't' ? Text : type == 'r' ? Real : Int64;
+        }
+        quint32 rows = 0;
+
+        while (q.next()) {
+            QStringList cells;
+            for (int i = 0; i < n; ++i) {
+                const QVariant v = q.value(i);
+                switch (types[i]) {
+                case Text: {
+                    const QString s = v.toString();
+                    *streams[i] << s;
+                    cells << (s.contains(',') || s.contains('"') || s.contains('\n')
+                                  ? '"' + QString(s).replace('"', "\"\"") + '"' : s);
+                    break;
+                }
+                case Real:
+                    *streams[i] << v.toDouble();
+                    cells << (v.isNull() ? QString() : QString::number(v.toDouble(), 'g', 6));
+                    break;
+                case Int64:
+                    *streams[i] << v.toLongLong();
+                    cells << (v.isNull() ? QString() : QString::number(v.toLongLong()));
+                    break;
+                }
+            }
+            ++rows;
+            out << cells.join(',') << '\n';
+        }
+        qDeleteAll(streams);
+
+        out.flush();
+        if (!csv.commit()) return fail(csv.errorString());
+
+        col << QString::fromLatin1(t.name) << rows << quint32(n);
+        for (int i = 0; i < n; ++i) col << rec.fieldName(i) << quint8(types[i]) << qCompress(blocks[i]);
+    }
+
+    if (!columnar.commit()) return fail(columnar.errorString());
+    qInfo() << "analytics exported to" << dir;
+    return true;
+}
+
+// ---- Rebuild ----
+
+bool Analytics::rebuild(QSqlDatabase db) {
+    QSqlQuery q(db);
+    const bool ok =
+        q.exec("DELETE FROM question_stats")
+        && q.exec("DELETE FROM question_picks")
+        && q.exec("DELETE FROM quest_funnel");
+    if (!ok) qWarning() << "analytics rebuild failed:" << q.lastError().text();
+    return ok && addHistory(db);
+}
+
+bool Analytics::addHistory(QSqlDatabase db) {
+    // Learners of different files are different learners: every counter,
+    // including learners and started, is a plain sum over files.
+    QSqlQuery q(db);
+    const bool ok =
+        // Per learner and question: attempts, first try, attempt number of the first correct one.
+        q.exec(R"(
+            INSERT INTO question_stats(question_id, attempts, correct, learners, first_try_correct, mastered, attempts_to_mastery)
+            SELECT question_id, SUM(n), SUM(c), COUNT(*), SUM(first_ok), COUNT(mastery), COALESCE(SUM(mastery), 0)
+            FROM (
+                SELECT user_id, question_id, COUNT(*) AS n, SUM(is_correct) AS c,
+                       MAX(rn = 1 AND is_correct) AS first_ok,
+                       MIN(CASE WHEN is_correct THEN rn END) AS mastery
+                FROM (
+                    SELECT user_id, question_id, is_correct,
+                           ROW_NUMBER() OVER (PARTITION BY user_id, question_id ORDER BY timestamp, id) AS rn
+                    FROM attempts_all
+                )
+                GROUP BY user_id, question_id
+            )
+            GROUP BY question_id
+            ON CONFLICT(question_id) DO UPDATE SET
+                attempts = attempts + excluded.attempts,
+                correct = correct + excluded.correct,
+                learners = learners + excluded.learners,
+                first_try_correct = first_try_correct + excluded.first_try_correct,
+                mastered = mastered + excluded.mastered,
+                attempts_to_mastery = attempts_to_mastery + excluded.attempts_to_mastery
+        )")
+        && q.exec(R"(
+            INSERT INTO question_picks(question_id, choice, picks)
+            SELECT question_id, answer, COUNT(*) FROM attempts_all WHERE answer >= 0 GROUP BY question_id, answer
+            ON CONFLICT(question_id, choice) DO UPDATE SET picks = picks + excluded.picks
+        )")
+        // WHERE true: without it SQLite would read ON CONFLICT as a join constraint.
+        && q.exec(QString(R"(
+            INSERT INTO quest_funnel(quest_id, started, completed)
+            SELECT qs.id,
+                   (SELECT COUNT(DISTINCT s.user_id) FROM attempt_summary s
+                    JOIN questions qu ON qu.id = s.question_id WHERE qu.quest_id = qs.id),
+                   (SELECT COUNT(*) FROM quest_progress p WHERE p.quest_id = qs.id AND p.status = %1)
+            FROM quests qs WHERE true
+            ON CONFLICT(quest_id) DO UPDATE SET
+                started = started + excluded.started,
+                completed = completed + excluded.completed
+        )").arg(int(Database::QuestCompleted)));
+    if (!ok) qWarning() << "analytics rebuild failed:" << q.lastError().text();
+    return ok;
+}
+
+bool Analytics::rebuildAll() {
+    // The shared file's own learners replace the counters; each cohort's
+    // are then added on a connection to its shard.
+    bool ok = Database::withCohort(QString(), [](QSqlDatabase db) {
+        return Database::write(db, [&] { return rebuild(db); }, "rebuild analytics");
+    });
+    for (const QString &cohort : Database::cohorts()) {
+        if (!ok) break;
+        ok = Database::withCohort(cohort, [](QSqlDatabase db) {
+            return Database::write(db, [&] { return addHistory(db); }, "rebuild analytics");
+        });
+    }
+    if (ok) qInfo() << "analytics rebuilt from every cohort";
+    return ok;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariantList>
+
+// Question and quest analytics for content authors.
+// Counters live in question_stats / question_picks / quest_funnel and are
+// bumped as attempts are recorded, using the learner's attempt_summary row
+// from just before the insert; reports read those few rows, never attempts.
+//
+//   first-try rate       = first_try_correct / learners
+//   attempts to mastery  = attempts_to_mastery / mastered
+//   distractor frequency = question_picks.picks per choice
+//   funnel               = started -> learners per question -> completed
+class Analytics {
+public:
+    struct Attempt {
+        int userId = -1;
+        int questionId = -1;
+        qint64 timestamp = 0;
+        bool correct = false;
+        int answer = -1;         // mcq: selected choice index
+        int origin = 0;          // 0 = recorded here, else sync_peers.id
+    };
+
+    // Inserts the attempt and updates attempt_summary and every counter.
+    // Runs inside the caller's transaction. wasMastered reports whether the
+    // learner had already answered this question correctly before.
+    static bool recordAttempt(QSqlDatabase db, const Attempt& a, bool* wasMastered = nullptr);
+    // A learner completed a quest for the first time.
+    static bool questCompleted(QSqlDatabase db, int questId);
+
+    // Bulk form for importers that aggregate per question themselves.
+    struct QuestionDelta {
+        qint64 attempts = 0, correct = 0;
+        bool firstTryCorrect = false;
+        qint64 attemptsToMastery = 0;   // 0: not mastered
+    };
+    static bool addLearner(QSqlDatabase db, int questionId, const QuestionDelta& d);
+    static bool addPicks(QSqlDatabase db, int questionId, int answer, qint64 picks);
+    static bool questStarted(QSqlDatabase db, int questId);
+    // Every quest a newly imported user has attempts in (from attempt_summary).
+    static bool questsStartedBy(QSqlDatabase db, int userId);
+
+    // [{questionId, questId, prompt, attempts, correctRate, firstTryRate,
+    //   meanAttemptsToMastery, learners, picks: [count per choice], suspect}]
+    static QVariantList questionReport(QSqlDatabase db, int questId = -1);
+    // [{questId, title, started, completed, steps: [learners per question]}]
+    static QVariantList questFunnel(QSqlDatabase db);
+
+    // question_stats.csv, question_picks.csv, quest_funnel.csv and
+    // analytics.clcol (columnar, one compressed block per column) in dir.
+    static bool exportTo(QSqlDatabase db, const QString& dir, QString* error = nullptr);
+
+    // Replaces the counters with those of db's own history. Runs inside
+    // the caller's transaction; on its own only where one file holds every
+    // learner (migrations before shards).
+    static bool rebuild(QSqlDatabase db);
+    // Recomputes the counters from the shared file and every cohort shard,
+    // one write per file (--rebuild-analytics). Attempts recorded by a
+    // running instance meanwhile may be missed or counted twice.
+    static bool rebuildAll();
+
+private:
+    // Adds the learners of db's main file (and its archive) to the counters.
+    static bool addHistory(QSqlDatabase db);
+};
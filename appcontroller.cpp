@@ -1,5 +1,11 @@
 #include "AppController.h"
 #include "Database.h"
+#include "attemptarchive.h"
+#include "backup.h"
+#include "profileio.h"
+#include "analytics.h"
+#include "progresssync.h"
+#include <QElapsedTimer>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
@@ -7,207 +13,644 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QDateTime>
+#include <QJSEngine>
+#include <QQuickWindow>
+#include <QFuture>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+
+// QML still sees the status names it always has.
+QString statusName(int status) {
+    switch (status) {
+    case Database::QuestUnlocked: return QStringLiteral("unlocked");
+    case Database::QuestCompleted: return QStringLiteral("completed");
+    default: return QStringLiteral("locked");
+    }
+}
+
+// GUI-thread writes give up quickly while another process holds the lock;
+// that is worth a retry, not an error report.
+QString dbError(const QString &what) {
+    return Database::lastWriteBusy() ? QStringLiteral("Database busy, try again")
+                                     : "DB error: " + what;
+}
+
+} // namespace
+
+
+AppController *AppController::s_instance = nullptr;
 
+AppController *AppController::create(QQmlEngine *, QJSEngine *jsEngine) {
+    Q_ASSERT(s_instance);
+    Q_ASSERT(jsEngine->thread() == s_instance->thread());
+    QJSEngine::setObjectOwnership(s_instance, QJSEngine::CppOwnership);
+    return s_instance;
+}
 
 AppController::AppController(QObject *parent) : QObject(parent) {
-    loadUsers();  // populate App.users for ComboBox ASAP
+    Q_ASSERT(!s_instance);
+    s_instance = this;
+
+    connect(&m_bus, &EventBus::toast, this, &AppController::toast);
+
+    // Each model refreshes at most once per event-loop turn, however many
+    // events a single action produced.
+    m_bus.subscribe(EventBus::XpAwarded, [this](EventBus::Events) {
+        emit totalXpChanged();
+        if (m_publishedLevel != m_level) {
+            m_publishedLevel = m_level;
+            emit levelChanged();
+        }
+    });
+    m_bus.subscribe(EventBus::DailyCompleted | EventBus::DailyProgressed,
+                    [this](EventBus::Events) { loadDailyTasks(); });
+
+    m_bus.subscribe(EventBus::AchievementUnlocked,
+                    [this](EventBus::Events) { emit achievementsChanged(); });
+
+    // Without table hooks the poll only sees other connections' commits;
+    // the controller's own writes say what they touched instead.
+    m_bus.subscribe(EventBus::AnswerGraded | EventBus::QuestCompleted,
+                    [this](EventBus::Events) { markWritten(QuestsModel); });
+    m_bus.subscribe(EventBus::XpAwarded | EventBus::QuestCompleted | EventBus::DailyCompleted,
+                    [this](EventBus::Events) { markWritten(LeaderboardModel); });
+
+    // Models backed by tables follow the tables, whoever wrote them.
+    connect(TableWatch::instance(), &TableWatch::changed, this, &AppController::onTablesChanged);
+    TableWatch::instance()->startPolling(Database::db());
+
+    connect(&m_dailies, &DailyTracker::dayRolledOver, this, &AppController::loadDailyTasks);
+    connect(&m_achievements, &AchievementEngine::unlocked, this, [this](const QString &title) {
+        m_bus.publish(EventBus::AchievementUnlocked, "Achievement unlocked: " + title);
+    });
+
+    // Background upkeep: old attempts move to the archive file and, when
+    // one is due, a backup snapshot is taken. Once shortly after launch,
+    // then every few hours.
+    m_maintenanceTimer.setInterval(2 * 60 * 1000);
+    connect(&m_maintenanceTimer, &QTimer::timeout, this, &AppController::runMaintenance);
+    m_maintenanceTimer.start();
+
+    // No DB work here: main() hands over the first screen's data through
+    // applyStartupData() once the QML engine has loaded.
+}
+
+AppController::~AppController() {
+    m_maintenance.waitForFinished();
+    m_profileIO.waitForFinished();
+    m_sync.waitForFinished();
+    if (s_instance == this) s_instance = nullptr;
+}
+
+void AppController::runMaintenance() {
+    m_maintenanceTimer.setInterval(6 * 60 * 60 * 1000);
+    if (m_maintenance.isRunning()) return;
+
+    // Archiving and backup share one worker so they never compete for the
+    // same files.
+    m_maintenance = QtConcurrent::run([] {
+        AttemptArchive::run();
+        return Backup::isDue() ? Backup::snapshot() : Backup::Report{};
+    });
+    m_maintenance.then(this, [this](const Backup::Report &r) {
+        workerWritten(0);   // archived attempts: no model shows them
+        if (!r.name.isEmpty()) emit backupsChanged();
+    });
+}
+
+void AppController::exportUser(const QString& username, const QString& path) {
+    const int userId = findUserId(Database::db(), username);
+    if (userId <= 0) {
+        emit toast("Export failed: no user " + username);
+        return;
+    }
+    if (m_profileIO.isRunning()) {
+        emit toast("Profile transfer in progress, try again shortly");
+        return;
+    }
+
+    // A long history takes a while to stream; the worker's own connection
+    // keeps the UI responsive meanwhile.
+    m_profileIO = QtConcurrent::run([userId, username, path] {
+        QElapsedTimer timer;
+        timer.start();
+        ProfileResult r;
+        QString error;
+        r.ok = ProfileIO::exportUser(userId, path, &error);
+        r.message = r.ok ? QString("Exported %1 to %2 in %3 ms").arg(username, path).arg(timer.elapsed())
+                         : "Export failed: " + error;
+        return r;
+    });
+    m_profileIO.then(this, [this](const ProfileResult &r) { emit toast(r.message); });
+}
 
-    if (!ensureUser("LocalUser")) {
-        qWarning() << "Failed to init default user";
+void AppController::importUser(const QString& path) {
+    if (m_profileIO.isRunning()) {
+        emit toast("Profile transfer in progress, try again shortly");
         return;
     }
 
-    loadUsers();  // LocalUser might have just been created
-    refresh();    // stats/quests/dailies/leaderboard for this user
+    m_profileIO = QtConcurrent::run([path] {
+        QElapsedTimer timer;
+        timer.start();
+        ProfileResult r;
+        QString error;
+        r.ok = ProfileIO::importUser(path, &error) > 0;
+        r.message = r.ok ? QString("Imported profile from %1 in %2 ms").arg(path).arg(timer.elapsed())
+                         : "Import failed: " + error;
+        return r;
+    });
+    m_profileIO.then(this, [this](const ProfileResult &r) {
+        workerWritten(r.ok ? UsersModel | LeaderboardModel : 0);
+        emit toast(r.message);
+    });
 }
 
+QVariantList AppController::questionReport(int questId) {
+    return Analytics::questionReport(Database::db(), questId);
+}
 
-int AppController::computeLevel(int xp) const {
-    // Simple leveling: every 200 XP = +1 level
-    return 1 + (xp / 200);
+QVariantList AppController::questFunnel() {
+    return Analytics::questFunnel(Database::db());
+}
+
+bool AppController::exportAnalytics(const QString& dir) {
+    QString error;
+    if (!Analytics::exportTo(Database::db(), dir, &error)) {
+        emit toast("Analytics export failed: " + error);
+        return false;
+    }
+    emit toast("Analytics written to " + dir);
+    return true;
+}
+
+QVariantMap AppController::timingReport() {
+    m_timing.flush();
+    return ResponseTimes::report(Database::db());
+}
+
+QVariantMap AppController::userTiming() {
+    m_timing.flush();
+    return ResponseTimes::userReport(Database::db(), m_userId);
+}
+
+void AppController::backupNow() {
+    if (m_maintenance.isRunning()) {
+        emit toast("Backup already running");
+        return;
+    }
+
+    m_maintenance = QtConcurrent::run(&Backup::snapshot);
+    m_maintenance.then(this, [this](const Backup::Report &r) {
+        emit backupsChanged();
+        if (!r.ok) {
+            emit toast("Backup failed: " + r.error);
+            return;
+        }
+        emit toast(QString("Backup %1: %2 KB in %3 ms, longest writer wait %4 ms")
+                       .arg(r.name).arg(r.bytes / 1024).arg(r.elapsedMs).arg(r.maxStallMs));
+    });
+}
+
+void AppController::restoreBackup(const QString& name) {
+    if (m_maintenance.isRunning() || m_profileIO.isRunning() || m_sync.isRunning()) {
+        emit toast("Backup, sync or profile transfer in progress, try again shortly");
+        return;
+    }
+
+    // Pending in-memory state belongs to the data being replaced.
+    m_achievements.flush();
+    m_timing.flush();
+
+    // Every shard is rewritten row by row; on the worker's connection that
+    // waits for other writers as long as it needs to, not the UI's 250 ms.
+    m_maintenance = QtConcurrent::run([name] {
+        QElapsedTimer timer;
+        timer.start();
+        Backup::Report r;
+        r.name = name;
+        r.ok = Backup::restore(name, &r.error);
+        r.elapsedMs = timer.elapsed();
+        return r;
+    });
+    m_maintenance.then(this, [this](const Backup::Report &r) {
+        workerWritten(0);   // everything is reloaded below
+        if (!r.ok) {
+            emit toast("Restore failed: " + r.error);
+            return;
+        }
+        if (!ensureUser(m_currentUser)) {
+            emit toast("Restore: failed to reload user");
+            return;
+        }
+        // Table hooks may be off (see Database::nativeApi); reload everything.
+        markStale(UsersModel);
+        refresh();
+        m_achievements.setUser(m_userId, m_level);
+        emit achievementsChanged();
+        emit toast(QString("Restored backup %1 in %2 ms").arg(r.name).arg(r.elapsedMs));
+    });
+}
+
+QString AppController::cohort() const {
+    return Database::currentCohort();
+}
+
+QStringList AppController::backups() const {
+    return Backup::snapshots();
+}
+
+
+bool AppController::awardXp(int xp, XpLedger::Source source, int ref) {
+    if (xp <= 0) return true;
+
+    const int newTotal = XpLedger::append(m_userId, source, xp, ref);
+    if (newTotal < 0) {
+        emit toast(dbError("failed to update XP"));
+        return false;
+    }
+    xpChanged(newTotal);
+    return true;
+}
+
+void AppController::xpChanged(int newTotal) {
+    // The ledger total also includes XP other instances added meanwhile.
+    const int newLevel = XpLedger::levelForXp(newTotal);
+    m_totalXp = newTotal;
+    const bool levelUp = (newLevel > m_level);
+    m_level = newLevel;
+    m_bus.publish(EventBus::XpAwarded, levelUp ? QStringLiteral("Level up!") : QString());
+    if (levelUp) m_achievements.onLevel(m_level);
+}
+
+void AppController::trackDaily(DailyTracker::Action action) {
+    int xpTotal = -1;
+    const auto completed = m_dailies.record(action, xpTotal);
+    if (completed.isEmpty()) {
+        m_bus.publish(EventBus::DailyProgressed);
+        return;
+    }
+
+    if (xpTotal >= 0) xpChanged(xpTotal);
+    for (const auto &t : completed) {
+        m_bus.publish(EventBus::DailyCompleted,
+                      QString("Daily complete: %1 +%2 XP").arg(t.title).arg(t.xp));
+    }
+}
+
+AppController::StartupData AppController::loadStartupData(const QString& username) {
+    StartupData out;
+    QSqlDatabase db = Database::threadDb();
+    if (!db.isOpen()) return out;
+
+    out.userId = findUserId(db, username);
+    if (out.userId <= 0) return out;
+    // A learner in a cohort needs that shard opened first; the slow path does.
+    if (!Database::cohortOf(db, out.userId).isEmpty()) {
+        out.userId = -1;
+        return out;
+    }
+
+    out.username = username;
+    out.users = queryUsers(db);
+    out.quests = queryQuests(db, out.userId);
+    return out;
+}
+
+void AppController::applyStartupData(const StartupData& data) {
+    if (data.userId > 0) {
+        selectUser(data.userId, data.username);
+        m_users = data.users;
+        m_quests = data.quests;
+        emit usersChanged();
+        emit questsChanged();
+        loadStats();
+    } else {
+        // Worker found nothing usable (e.g. user missing): do it the slow way
+        if (!ensureUser("LocalUser")) {
+            qWarning() << "Failed to init default user";
+            return;
+        }
+        markStale(UsersModel);
+        refresh();
+    }
+
+    // Dailies and leaderboard are not on the first screen; their pages load them.
+    m_achievements.setUser(m_userId, m_level);
+    emit achievementsChanged();
+}
+
+void AppController::trackFrames(QQuickWindow *window) {
+    // With the threaded render loop this arrives queued, so "on screen"
+    // includes the trip back to the GUI thread.
+    connect(window, &QQuickWindow::frameSwapped, this, [this] { m_timing.frameSwapped(); });
 }
 
 void AppController::refresh() {
+    invalidatePrefetch();
     loadStats();
-    loadQuests();
     loadDailyTasks();
-    loadLeaderboard();
+    markStale(QuestsModel | LeaderboardModel);
 }
 
-void AppController::loadStats() {
-    QSqlQuery q(Database::db());
-    q.prepare("SELECT total_xp, level FROM user_stats WHERE user_id = ?");
-    q.addBindValue(m_userId);
+void AppController::markStale(int models) {
+    m_stale |= models;
+    if (models & QuestsModel) emit questsChanged();
+    if (models & LeaderboardModel) emit leaderboardChanged();
+    if (models & UsersModel) emit usersChanged();
+}
 
-    if (!q.exec()) { qWarning() << q.lastError().text(); return; }
-    if (q.next()) {
-        m_totalXp = q.value(0).toInt();
-        m_level = q.value(1).toInt();
-        emit totalXpChanged();
-        emit levelChanged();
+void AppController::markWritten(int models) {
+    if (!TableWatch::hooksActive()) markStale(models);
+}
+
+void AppController::workerWritten(int models) {
+    markWritten(models);
+    TableWatch::instance()->skipOwnWrites();
+}
+
+void AppController::onTablesChanged(TableWatch::Tables tables, bool foreign) {
+    // Without hooks only the poll reports, always as kAll: everything below
+    // runs, for another process's commit of any table.
+    int stale = 0;
+    if (tables & (TableWatch::Content | TableWatch::Progress)) stale |= QuestsModel;
+    if (tables & (TableWatch::Users | TableWatch::Xp)) stale |= LeaderboardModel;
+    if (tables & TableWatch::Users) stale |= UsersModel;
+    markStale(stale);
+
+    // Our own writes keep the in-memory state current as they go; anyone
+    // else's may have changed what it was derived from.
+    if (!foreign || m_userId <= 0) return;
+    if (tables & (TableWatch::Content | TableWatch::Progress | TableWatch::Attempts)) invalidatePrefetch();
+    if (tables & TableWatch::Xp) loadStats();
+    if (tables & (TableWatch::Content | TableWatch::Other)) {
+        m_dailies.setUser(m_userId);   // daily_* have no update hook
+        loadDailyTasks();
     }
 }
 
+void AppController::loadStats() {
+    const int total = XpLedger::total(m_userId);
+    if (total < 0) return;
 
-void AppController::loadQuests() {
-    QVariantList list;
+    m_totalXp = total;
+    m_level = XpLedger::levelForXp(total);
+    m_publishedLevel = m_level;
+    emit totalXpChanged();
+    emit levelChanged();
+}
 
-    QSqlQuery q(Database::db());
+
+QList<QuestSummary> AppController::queryQuests(QSqlDatabase db, int userId) {
+    QList<QuestSummary> list;
+
+    QSqlQuery q(db);
     q.prepare(R"(
         SELECT q.id, q.title, q.topic, q.difficulty,
-               COALESCE(p.status, 'locked') as status,
+               COALESCE(p.status, 0) as status,
                COALESCE(p.best_score, 0) as best_score
         FROM quests q
         LEFT JOIN quest_progress p
           ON p.quest_id = q.id AND p.user_id = ?
         ORDER BY q.id ASC
     )");
-    q.addBindValue(m_userId);
+    q.addBindValue(userId);
 
     if (!q.exec()) {
         qWarning() << q.lastError().text();
-        return;
+        return list;
     }
 
     while (q.next()) {
-        QVariantMap m;
-        m["id"] = q.value(0).toInt();
-        m["title"] = q.value(1).toString();
-        m["topic"] = q.value(2).toString();
-        m["difficulty"] = q.value(3).toInt();
-        m["status"] = q.value(4).toString();
-        m["bestScore"] = q.value(5).toInt();
-        list.append(m);
+        QuestSummary &m = list.emplace_back();
+        m.id = q.value(0).toInt();
+        m.title = q.value(1).toString();
+        m.topic = q.value(2).toString();
+        m.difficulty = q.value(3).toInt();
+        m.status = statusName(q.value(4).toInt());
+        m.bestScore = q.value(5).toInt();
     }
+    return list;
+}
 
-    m_quests = list;
-    emit questsChanged();
+QList<QuestSummary> AppController::quests() {
+    if (m_stale & QuestsModel) {
+        m_stale &= ~QuestsModel;
+        m_quests = queryQuests(Database::db(), m_userId);
+    }
+    return m_quests;
 }
 
 
 void AppController::completeQuest(int questId, int xpEarned, int score) {
-    // Mark completed, update best score, unlock next quest
-    {
-        QSqlQuery q(Database::db());
+    // Mark completed, update best score, unlock next quest; the status read
+    // and both writes form one unit so another instance cannot interleave.
+    QSqlDatabase db = Database::db();
+    const bool saved = Database::write(db, [&] {
+        bool firstCompletion = true;
+        QSqlQuery prev(db);
+        prev.prepare("SELECT status FROM quest_progress WHERE user_id=? AND quest_id=?");
+        prev.addBindValue(m_userId);
+        prev.addBindValue(questId);
+        if (!prev.exec()) return false;
+        if (prev.next()) firstCompletion = prev.value(0).toInt() != Database::QuestCompleted;
+
+        QSqlQuery q(db);
         q.prepare(R"(
         INSERT INTO quest_progress(user_id, quest_id, status, best_score, last_attempt)
-        VALUES(?, ?, 'completed', ?, datetime('now'))
+        VALUES(?, ?, ?, ?, ?)
         ON CONFLICT(user_id, quest_id) DO UPDATE SET
-            status='completed',
+            status=excluded.status,
             best_score=MAX(best_score, excluded.best_score),
-            last_attempt=datetime('now')
+            last_attempt=excluded.last_attempt
         )");
         q.addBindValue(m_userId);
         q.addBindValue(questId);
+        q.addBindValue(int(Database::QuestCompleted));
         q.addBindValue(score);
+        q.addBindValue(Database::now());
+        if (!q.exec()) return false;
+        if (firstCompletion && !Analytics::questCompleted(db, questId)) return false;
 
-        if (!q.exec()) {
-            emit toast("DB error: failed to save progress");
-            return;
-        }
-    }
-
-    // Unlock next quest by id order
-    int nextId = -1;
-    {
-        QSqlQuery n(Database::db());
+        // Unlock next quest by id order
+        QSqlQuery n(db);
         n.prepare("SELECT id FROM quests WHERE id > ? ORDER BY id ASC LIMIT 1");
         n.addBindValue(questId);
-        if (n.exec() && n.next()) nextId = n.value(0).toInt();
-    }
+        if (!n.exec()) return false;
+        if (!n.next()) return true;
 
-    if (nextId > 0) {
-        QSqlQuery q(Database::db());
-        q.prepare(R"(
+        QSqlQuery u(db);
+        u.prepare(R"(
         INSERT INTO quest_progress(user_id, quest_id, status)
-        VALUES(?, ?, 'unlocked')
-        ON CONFLICT(user_id, quest_id) DO UPDATE SET status='unlocked'
+        VALUES(?, ?, ?)
+        ON CONFLICT(user_id, quest_id) DO UPDATE SET status=MAX(status, excluded.status)
     )");
-        q.addBindValue(m_userId);
-        q.addBindValue(nextId);
-        q.exec();
-    }
-
-
-    // Add XP + recompute level
-    m_totalXp += xpEarned;
-    int newLevel = computeLevel(m_totalXp);
-
-    {
-        QSqlQuery q(Database::db());
-        q.prepare("UPDATE user_stats SET total_xp=?, level=?, last_active=datetime('now') WHERE user_id=?");
-        q.addBindValue(m_totalXp);
-        q.addBindValue(newLevel);
-        q.addBindValue(m_userId);
-        if (!q.exec()) {
-            emit toast("DB error: failed to update XP");
-            return;
-        }
+        u.addBindValue(m_userId);
+        u.addBindValue(n.value(0).toInt());
+        u.addBindValue(int(Database::QuestUnlocked));
+        return u.exec();
+    }, "save quest progress");
+
+    if (!saved) {
+        emit toast(dbError("failed to save progress"));
+        return;
     }
 
-    if (newLevel != m_level) {
-        m_level = newLevel;
-        emit levelChanged();
-        emit toast("Level up!");
-    }
+    m_achievements.onQuestCompleted(questId);
+    if (!awardXp(xpEarned, XpLedger::Quest, questId)) return;
 
-    emit totalXpChanged();
-    loadQuests();
-    emit toast("Quest completed +XP");
+    m_bus.publish(EventBus::QuestCompleted, QStringLiteral("Quest completed!"));
+    trackDaily(DailyTracker::QuestCompleted);
 }
 
-QVariantMap AppController::getNextQuestion(int questId) {
-    QVariantMap out;
+Question AppController::queryNextQuestion(QSqlDatabase db, int userId, int questId, int assumeMasteredId) {
+    Question out;
 
-    QSqlQuery q(Database::db());
+    QSqlQuery q(db);
     // Pick first question not yet answered correctly; fallback to first question.
+    // assumeMasteredId lets the prefetcher ask "what comes after a correct answer".
     q.prepare(R"(
         SELECT qu.id, qu.type, qu.prompt, qu.choices_json, qu.answer_json, qu.xp_value
         FROM questions qu
-        LEFT JOIN (
-            SELECT question_id, MAX(is_correct) AS any_correct
-            FROM attempts
-            WHERE user_id = ?
-            GROUP BY question_id
-        ) a ON a.question_id = qu.id
+        LEFT JOIN attempt_summary s
+          ON s.user_id = ? AND s.question_id = qu.id
         WHERE qu.quest_id = ?
-            AND COALESCE(a.any_correct, 0) = 0
+            AND qu.id != ?
+            AND COALESCE(s.correct, 0) = 0
         ORDER BY qu.id ASC
         LIMIT 1
     )");
-    q.addBindValue(m_userId);
+    q.addBindValue(userId);
     q.addBindValue(questId);
+    q.addBindValue(assumeMasteredId);
 
-    if (!q.exec()) return out;
+    if (!q.exec()) {
+        qWarning() << "next question failed:" << q.lastError().text();
+        return out;
+    }
 
     if (!q.next()) {
         // No unanswered questions left => quest mastered
-        return out; // empty map
+        return out; // invalid question
     }
 
-    const int id = q.value(0).toInt();
-    const QString type = q.value(1).toString();
-    const QString prompt = q.value(2).toString();
-    const QString choicesStr = q.value(3).toString();
-    const int xp = q.value(5).toInt();
+    out.id = q.value(0).toInt();
+    out.type = q.value(1).toString();
+    out.prompt = q.value(2).toString();
+    out.xp = q.value(5).toInt();
 
-    // choices_json -> QVariantList
-    QVariantList choices;
+    // choices_json -> QStringList
     {
-        const auto doc = QJsonDocument::fromJson(choicesStr.toUtf8());
+        const auto doc = QJsonDocument::fromJson(q.value(3).toString().toUtf8());
         if (doc.isArray()) {
-            for (auto v : doc.array()) choices.append(v.toVariant());
+            const QJsonArray choices = doc.array();
+            out.choices.reserve(choices.size());
+            for (const auto &v : choices) out.choices.append(v.toVariant().toString());
         }
     }
+    return out;
+}
 
-    out["id"] = id;
-    out["type"] = type;
-    out["prompt"] = prompt;
-    out["choices"] = choices;
-    out["xp"] = xp;
+QString AppController::queryLesson(QSqlDatabase db, int questId) {
+    QSqlQuery q(db);
+    q.prepare("SELECT body FROM lessons WHERE quest_id = ?");
+    q.addBindValue(questId);
+    if (!q.exec() || !q.next()) return QString();
+    return q.value(0).toString();
+}
+
+Question AppController::getNextQuestion(int questId) {
+    const quint64 key = prefetchKey(questId, -1);
+
+    // Only the prefetcher fills the cache: a direct read would stay there
+    // after the answer it was read before, and be served again.
+    const auto it = m_prefetched.constFind(key);
+    const Question out = it != m_prefetched.cend() ? it.value()
+                                                   : queryNextQuestion(Database::db(), m_userId, questId, -1);
+
+    m_timing.questionShown(out.id);
+    if (out.isValid()) schedulePrefetch(questId, out.id);
     return out;
 }
 
+quint64 AppController::prefetchKey(int questId, int afterQuestionId) {
+    return (quint64(quint32(questId)) << 32) | quint32(afterQuestionId);
+}
+
+AppController::PrefetchResult AppController::prefetch(int userId, int questId, int questionId) {
+    PrefetchResult r;
+    QSqlDatabase db = Database::threadDb();
+    if (!db.isOpen()) return r;
+
+    // Wrong answer: the same question comes back, which the buffer already has.
+    // Right answer: the next unmastered question of this quest.
+    r.ifCorrect = queryNextQuestion(db, userId, questId, questionId);
+
+    // And the next quest, in case this answer finishes the current one.
+    QSqlQuery n(db);
+    n.prepare("SELECT id FROM quests WHERE id > ? ORDER BY id ASC LIMIT 1");
+    n.addBindValue(questId);
+    if (n.exec() && n.next()) {
+        r.nextQuestId = n.value(0).toInt();
+        r.nextLesson = queryLesson(db, r.nextQuestId);
+        r.nextFirst = queryNextQuestion(db, userId, r.nextQuestId, -1);
+    }
+    r.ok = true;
+    return r;
+}
+
+void AppController::schedulePrefetch(int questId, int questionId) {
+    const quint64 afterKey = prefetchKey(questId, questionId);
+    if (m_prefetched.contains(afterKey)) return;
+
+    if (m_prefetched.size() > kPrefetchLimit) m_prefetched.clear();
+
+    const quint64 gen = m_prefetchGen;
+    const int userId = m_userId;
+    QtConcurrent::run(&AppController::prefetch, userId, questId, questionId)
+        .then(this, [this, gen, questId, questionId](const PrefetchResult &r) {
+            // Anything written since launch (answers, user switch) may have
+            // changed the result; drop it and let the next lookup query directly.
+            if (!r.ok || gen != m_prefetchGen) return;
+
+            m_prefetched.insert(prefetchKey(questId, questionId), r.ifCorrect);
+            if (r.nextQuestId > 0) {
+                m_lessonCache.insert(r.nextQuestId, r.nextLesson);
+                m_prefetched.insert(prefetchKey(r.nextQuestId, -1), r.nextFirst);
+            }
+        });
+}
+
+void AppController::invalidatePrefetch() {
+    ++m_prefetchGen;
+    m_prefetched.clear();
+    m_lessonCache.clear();
+}
+
+void AppController::onAnswerRecorded(int questId, int questionId, bool correct) {
+    ++m_prefetchGen;
+
+    // Only this quest's entries can change. A correct answer turns the
+    // "after questionId" guess into the current state; a wrong one leaves
+    // the current state as is.
+    const quint64 currentKey = prefetchKey(questId, -1);
+    const quint64 afterKey = prefetchKey(questId, questionId);
+    const bool haveAfter = m_prefetched.contains(afterKey);
+    const Question after = m_prefetched.value(afterKey);
+    const Question current = m_prefetched.value(currentKey);
+    const bool haveCurrent = m_prefetched.contains(currentKey);
+
+    for (auto it = m_prefetched.begin(); it != m_prefetched.end();) {
+        if (int(it.key() >> 32) == questId) it = m_prefetched.erase(it);
+        else ++it;
+    }
+
+    if (correct && haveAfter) m_prefetched.insert(currentKey, after);
+    else if (!correct && haveCurrent) m_prefetched.insert(currentKey, current);
+}
+
 bool AppController::submitAnswer(int questionId, const QVariant &userAnswer) {
     // Load correct answer
     QSqlQuery q(Database::db());
@@ -221,6 +664,7 @@ bool AppController::submitAnswer(int questionId, const QVariant &userAnswer) {
     const int questId = q.value(0).toInt();
     const QString answerStr = q.value(1).toString();
     const int xpValue = q.value(2).toInt();
+    m_timing.answered(questionId);
 
     int correctIndex = -1;
     {
@@ -231,57 +675,39 @@ bool AppController::submitAnswer(int questionId, const QVariant &userAnswer) {
     const int userIndex = userAnswer.toInt(); // for MCQ we pass index
     const bool correct = (userIndex == correctIndex);
     bool alreadyCorrect = false;
-    if (correct) {
-        QSqlQuery prev(Database::db());
-        prev.prepare("SELECT 1 FROM attempts WHERE user_id=? AND question_id=? AND is_correct=1 LIMIT 1");
-        prev.addBindValue(m_userId);
-        prev.addBindValue(questionId);
-        if (prev.exec() && prev.next()) alreadyCorrect = true;
-    }
-    // Save attempt
+    int xpTotal = -1;   // set when this answer earned XP
+    // Save attempt, its per-question summary, the author counters and the
+    // XP it earns together: an answer is never kept without its XP.
     {
-        QJsonObject ua;
-        ua["selectedIndex"] = userIndex;
-        const QString uaStr = QString::fromUtf8(QJsonDocument(ua).toJson(QJsonDocument::Compact));
-
-        QSqlQuery ins(Database::db());
-        ins.prepare(R"(
-            INSERT INTO attempts(user_id, question_id, is_correct, user_answer_json)
-            VALUES(?, ?, ?, ?)
-        )");
-        ins.addBindValue(m_userId);
-        ins.addBindValue(questionId);
-        ins.addBindValue(correct ? 1 : 0);
-        ins.addBindValue(uaStr);
-
-        if (!ins.exec()) {
-            emit toast("DB error saving attempt");
+        QSqlDatabase db = Database::db();
+        Analytics::Attempt a;
+        a.userId = m_userId;
+        a.questionId = questionId;
+        a.timestamp = Database::now();
+        a.correct = correct;
+        a.answer = userIndex;
+
+        if (!Database::write(db, [&] {
+                xpTotal = -1;
+                if (!Analytics::recordAttempt(db, a, &alreadyCorrect)) return false;
+                if (!correct || alreadyCorrect || xpValue <= 0) return true;
+                return (xpTotal = XpLedger::appendIn(db, m_userId, XpLedger::Answer, xpValue)) >= 0;
+            }, "save attempt")) {
+            emit toast(dbError("failed to save attempt"));
             return false;
         }
     }
 
+    onAnswerRecorded(questId, questionId, correct);
+    trackDaily(DailyTracker::AnswerSubmitted);
+    m_achievements.onAnswer(correct);
+
     if (correct) {
         if (alreadyCorrect) {
-            emit toast("Correct (already mastered). No XP awarded.");
+            m_bus.publish(EventBus::AnswerGraded, QStringLiteral("Correct (already mastered). No XP awarded."));
         } else {
-            m_totalXp += xpValue;
-            const int newLevel = computeLevel(m_totalXp);
-
-            QSqlQuery upd(Database::db());
-            upd.prepare("UPDATE user_stats SET total_xp=?, level=?, last_active=datetime('now') WHERE user_id=?");
-            upd.addBindValue(m_totalXp);
-            upd.addBindValue(newLevel);
-            upd.addBindValue(m_userId);
-            if (upd.exec()) {
-                emit totalXpChanged();
-                if (newLevel != m_level) {
-                    m_level = newLevel;
-                    emit levelChanged();
-                    emit toast("Correct! Level up!");
-                } else {
-                    emit toast(QString("Correct! +%1 XP").arg(xpValue));
-                }
-            }
+            if (xpTotal >= 0) xpChanged(xpTotal);
+            m_bus.publish(EventBus::AnswerGraded, QString("Correct! +%1 XP").arg(xpValue));
         }
 
         // If all questions in quest have at least one correct attempt, complete quest (0 XP here)
@@ -289,19 +715,21 @@ bool AppController::submitAnswer(int questionId, const QVariant &userAnswer) {
         qc.prepare(R"(
             SELECT
             (SELECT COUNT(*) FROM questions WHERE quest_id = ?) AS total_q,
-            (SELECT COUNT(DISTINCT qu.id)
+            (SELECT COUNT(*)
               FROM questions qu
-              JOIN attempts a
-                ON a.question_id = qu.id
-               AND a.is_correct = 1
-               AND a.user_id = ?
+              JOIN attempt_summary s
+                ON s.user_id = ?
+               AND s.question_id = qu.id
+               AND s.correct > 0
               WHERE qu.quest_id = ?) AS correct_q
         )");
         qc.addBindValue(questId);
         qc.addBindValue(m_userId);
         qc.addBindValue(questId);
 
-        if (qc.exec() && qc.next()) {
+        if (!qc.exec()) {
+            qWarning() << "quest mastery check failed:" << qc.lastError().text();
+        } else if (qc.next()) {
             const int totalQ = qc.value(0).toInt();
             const int correctQ = qc.value(1).toInt();
             if (totalQ > 0 && correctQ >= totalQ) {
@@ -309,193 +737,240 @@ bool AppController::submitAnswer(int questionId, const QVariant &userAnswer) {
             }
         }
 
-        loadQuests();
         return true;
     } else {
-        emit toast("Not quite. Try again.");
+        m_bus.publish(EventBus::AnswerGraded, QStringLiteral("Not quite. Try again."));
         return false;
     }
 }
 
 QString AppController::getLesson(int questId) {
-    QSqlQuery q(Database::db());
-    q.prepare("SELECT body FROM lessons WHERE quest_id = ?");
-    q.addBindValue(questId);
-    if (q.exec() && q.next()) return q.value(0).toString();
-    return "";
-}
+    auto it = m_lessonCache.constFind(questId);
+    if (it == m_lessonCache.cend())
+        it = m_lessonCache.insert(questId, queryLesson(Database::db(), questId));
 
-bool AppController::ensureUser(const QString& username) {
-    QSqlQuery ins(Database::db());
-    ins.prepare("INSERT OR IGNORE INTO users(username) VALUES(?)");
-    ins.addBindValue(username);
-    if (!ins.exec()) return false;
+    if (it.value().isEmpty()) return "";
 
-    QSqlQuery q(Database::db());
+    trackDaily(DailyTracker::LessonOpened);
+    return it.value();
+}
+
+int AppController::findUserId(QSqlDatabase db, const QString& username) {
+    QSqlQuery q(db);
     q.prepare("SELECT id FROM users WHERE username=? LIMIT 1");
     q.addBindValue(username);
-    if (!q.exec() || !q.next()) return false;
+    if (!q.exec() || !q.next()) return -1;
+    return q.value(0).toInt();
+}
 
-    m_userId = q.value(0).toInt();
-    m_currentUser = username;
+bool AppController::ensureUser(const QString& username, const QString& cohort) {
+    int id = findUserId(Database::db(), username);
 
-    if (!Database::initProgressForUser(m_userId)) {
-        qWarning() << "Failed to init progress for user" << m_userId;
-        // you can return false here if you want to fail hard:
-        // return false;
-        return false;
+    // A learner's rows live in their cohort's shard; new ones join `cohort`.
+    const QString target = id > 0 ? Database::cohortOf(Database::db(), id) : cohort;
+    if (target != Database::currentCohort()) {
+        m_achievements.flush();   // pending state belongs to the open shard
+        m_timing.flush();
+        if (!Database::useCohort(target)) return false;
+        emit cohortChanged();
     }
 
-    QSqlQuery st(Database::db());
-    st.prepare("INSERT OR IGNORE INTO user_stats(user_id,total_xp,level,last_active) VALUES(?,0,1,datetime('now'))");
-    st.addBindValue(m_userId);
-    st.exec();
+    if (id <= 0) {
+        // New user: progress and stats rows are created once, here.
+        id = Database::createUser(Database::db(), username);
+        if (id <= 0) return false;
+    } else if (!Database::ensureUserRows(Database::db(), id)) {
+        return false;   // creation cut short by a crash, and still failing
+    }
 
-    emit currentUserChanged();
+    selectUser(id, username);
     return true;
 }
 
+void AppController::selectUser(int userId, const QString& username) {
+    invalidatePrefetch();
+    m_userId = userId;
+    m_currentUser = username;
+    m_dailies.setUser(m_userId);
+    m_timing.setUser(m_userId);
+    emit currentUserChanged();
+}
+
 
-void AppController::setCurrentUser(const QString& username) {
+void AppController::setCurrentUser(const QString& username, const QString& cohort) {
     const QString u = username.trimmed();
     if (u.isEmpty()) return;
+    if (!cohort.isEmpty() && !Database::isValidCohort(cohort)) {
+        emit toast("Invalid cohort name: " + cohort);
+        return;
+    }
 
-    if (!ensureUser(u)) {
+    if (!ensureUser(u, cohort)) {
         emit toast("Failed to switch user");
         return;
     }
 
-    loadUsers(); // update ComboBox if new user was added
+    markWritten(UsersModel);   // a new user may have been added
     refresh();   // loads stats/quests/dailies/leaderboard
+    m_achievements.setUser(m_userId, m_level);
+    emit achievementsChanged();
     emit toast("Switched user: " + m_currentUser);
 }
 
-void AppController::loadDailyTasks() {
-    QVariantList out;
-
-    QSqlQuery q(Database::db());
-    q.prepare(R"(
-        SELECT dt.id, dt.title, dt.xp_value,
-               EXISTS(
-                 SELECT 1 FROM daily_completions dc
-                 WHERE dc.user_id = ?
-                   AND dc.task_id = dt.id
-                   AND dc.day = date('now')
-               ) AS done_today
-        FROM daily_tasks dt
-        WHERE dt.active = 1
-        ORDER BY dt.id ASC
-    )");
-    q.addBindValue(m_userId);
+void AppController::syncProgress(const QString& dir) {
+    if (m_sync.isRunning()) {
+        emit toast("Sync already running");
+        return;
+    }
+    const QString folder = dir.isEmpty() ? ProgressSync::defaultDir() : dir;
+
+    // Reading deltas from a USB stick or network folder and writing one
+    // back take a while; the worker's own connection keeps the UI going.
+    m_sync = QtConcurrent::run([folder, userId = m_userId] {
+        QElapsedTimer timer;
+        timer.start();
+        SyncResult r;
+        r.imported = ProgressSync::importDir(folder, &r.touched);
+        r.exported = ProgressSync::exportUser(userId, folder);
+        r.elapsedMs = timer.elapsed();
+        return r;
+    });
+    m_sync.then(this, [this, folder](const SyncResult &r) {
+        // Users and leaderboard follow the imported rows on their own (with
+        // table hooks); the current user's in-memory state is reloaded here.
+        workerWritten(r.touched.isEmpty() ? 0 : UsersModel | LeaderboardModel);
+        if (r.touched.contains(m_userId)) {
+            m_dailies.setUser(m_userId);
+            refresh();
+            m_achievements.setUser(m_userId, m_level);
+            emit achievementsChanged();
+        }
 
-    if (!q.exec()) return;
+        if (r.imported < 0 || r.exported < 0) {
+            emit toast("Sync incomplete, see log: " + folder);
+            return;
+        }
+        emit toast(QString("Sync: merged %1 file(s), exported %2 row(s) in %3 ms")
+                       .arg(r.imported).arg(r.exported).arg(r.elapsedMs));
+    });
+}
 
-    while (q.next()) {
-        QVariantMap m;
-        m["id"] = q.value(0).toInt();
-        m["title"] = q.value(1).toString();
-        m["xp"] = q.value(2).toInt();
-        m["done"] = (q.value(3).toInt() == 1);
-        out.append(m);
+QList<DailyTask> AppController::dailyRows(const QVector<DailyTracker::Task>& tasks) {
+    QList<DailyTask> out;
+    out.reserve(tasks.size());
+
+    for (const auto &t : tasks) {
+        DailyTask &m = out.emplace_back();
+        m.id = t.id;
+        m.title = t.title;
+        m.xp = t.xp;
+        m.done = t.done;
+        m.manual = (t.action == DailyTracker::Manual);
+        m.progress = qMin(t.count, t.target);
+        m.target = t.target;
     }
+    return out;
+}
 
-    m_dailyTasks = out;
+void AppController::loadDailyTasks() {
+    m_dailyTasks = dailyRows(m_dailies.tasks());
     emit dailyTasksChanged();
 }
 
-void AppController::refreshDaily() { loadDailyTasks(); }
+void AppController::refreshDaily() {
+    m_dailies.setUser(m_userId);
+    loadDailyTasks();
+}
 
 void AppController::completeDailyTask(int taskId) {
-    // already done today?
-    QSqlQuery chk(Database::db());
-    chk.prepare("SELECT 1 FROM daily_completions WHERE user_id=? AND task_id=? AND day=date('now') LIMIT 1");
-    chk.addBindValue(m_userId);
-    chk.addBindValue(taskId);
-    if (chk.exec() && chk.next()) {
-        emit toast("Daily already completed today.");
+    const DailyTracker::Task *t = m_dailies.task(taskId);
+    if (!t) { emit toast("Daily task not found"); return; }
+    if (t->done) { emit toast("Daily already completed today."); return; }
+    if (t->action != DailyTracker::Manual) {
+        emit toast("This daily completes automatically as you play.");
         return;
     }
 
-    // get XP
-    QSqlQuery q(Database::db());
-    q.prepare("SELECT xp_value FROM daily_tasks WHERE id=? AND active=1");
-    q.addBindValue(taskId);
-    if (!q.exec() || !q.next()) { emit toast("Daily task not found"); return; }
-    int xp = q.value(0).toInt();
-
-    // insert completion
-    QSqlQuery ins(Database::db());
-    ins.prepare("INSERT INTO daily_completions(user_id, task_id, day) VALUES(?, ?, date('now'))");
-    ins.addBindValue(m_userId);
-    ins.addBindValue(taskId);
-    if (!ins.exec()) { emit toast("Failed to save daily completion"); return; }
-
-    // add XP
-    m_totalXp += xp;
-    int newLevel = computeLevel(m_totalXp);
-
-    QSqlQuery upd(Database::db());
-    upd.prepare("UPDATE user_stats SET total_xp=?, level=?, last_active=datetime('now') WHERE user_id=?");
-    upd.addBindValue(m_totalXp);
-    upd.addBindValue(newLevel);
-    upd.addBindValue(m_userId);
-    upd.exec();
-
-    emit totalXpChanged();
-    if (newLevel != m_level) { m_level = newLevel; emit levelChanged(); emit toast("Daily complete + Level up!"); }
-    else emit toast(QString("Daily complete +%1 XP").arg(xp));
+    const int xp = t->xp;
+    int xpTotal = -1;
+    if (!m_dailies.completeManual(taskId, xpTotal)) {
+        // Done now means another instance completed it first.
+        const DailyTracker::Task *now = m_dailies.task(taskId);
+        const bool done = now && now->done;
+        if (done) loadDailyTasks();
+        emit toast(done ? QStringLiteral("Daily already completed today.") : dbError("failed to save daily completion"));
+        return;
+    }
+    m_achievements.onActive();
 
-    loadDailyTasks();
-    loadLeaderboard();
+    if (xpTotal >= 0) xpChanged(xpTotal);
+    m_bus.publish(EventBus::DailyCompleted, QString("Daily complete +%1 XP").arg(xp));
 }
-void AppController::loadLeaderboard() {
-    QVariantList out;
 
-    QSqlQuery q(Database::db());
-    q.exec(R"(
+QList<LeaderboardEntry> AppController::queryLeaderboard(QSqlDatabase db) {
+    QList<LeaderboardEntry> out;
+
+    QSqlQuery q(db);
+    q.prepare(R"(
         SELECT u.username,
                s.total_xp,
                s.level,
                s.last_active,
                (s.total_xp +
-                 MAX(0, 200 - (julianday('now') - julianday(s.last_active)) * 20)
+                 MAX(0, 200 - (? - COALESCE(s.last_active, 0)) / 86400.0 * 20)
                ) AS rank_score
-        FROM user_stats s
+        FROM leaderboard_agg s
         JOIN users u ON u.id = s.user_id
         ORDER BY rank_score DESC
         LIMIT 20
     )");
+    q.addBindValue(Database::now());
+    if (!q.exec()) {
+        qWarning() << "leaderboard failed:" << q.lastError().text();
+        return out;
+    }
 
     while (q.next()) {
-        QVariantMap m;
-        m["username"] = q.value(0).toString();
-        m["xp"] = q.value(1).toInt();
-        m["level"] = q.value(2).toInt();
-        m["lastActive"] = q.value(3).toString();
-        m["score"] = q.value(4).toDouble();
-        out.append(m);
+        LeaderboardEntry &m = out.emplace_back();
+        m.username = q.value(0).toString();
+        m.xp = q.value(1).toInt();
+        m.level = q.value(2).toInt();
+        if (!q.value(3).isNull())
+            m.lastActive = QDateTime::fromSecsSinceEpoch(q.value(3).toLongLong()).toString(Qt::ISODate);
+        m.score = q.value(4).toDouble();
     }
 
-    m_leaderboard = out;
-    emit leaderboardChanged();
+    return out;
 }
 
-void AppController::refreshLeaderboard() { loadLeaderboard(); }
+QList<LeaderboardEntry> AppController::leaderboard() {
+    if (m_stale & LeaderboardModel) {
+        m_stale &= ~LeaderboardModel;
+        m_leaderboard = queryLeaderboard(Database::db());
+    }
+    return m_leaderboard;
+}
 
-void AppController::loadUsers() {
+// Rank scores decay with time, so an explicit refresh re-reads regardless.
+void AppController::refreshLeaderboard() { markStale(LeaderboardModel); }
+
+QVariantList AppController::queryUsers(QSqlDatabase db) {
     QVariantList out;
 
-    QSqlQuery q(Database::db());
+    QSqlQuery q(db);
     if (!q.exec("SELECT username FROM users ORDER BY username COLLATE NOCASE ASC")) {
         qWarning() << q.lastError().text();
-        return;
+        return out;
     }
 
     while (q.next()) out.append(q.value(0).toString());
-
-    m_users = out;
-    emit usersChanged();
+    return out;
 }
 
-
-
+QVariantList AppController::users() {
+    if (m_stale & UsersModel) {
+        m_stale &= ~UsersModel;
+        m_users = queryUsers(Database::db());
+    }
+    return m_users;
+}
@@ -2,37 +2,82 @@
 #include <QObject>
 #include <QVariantList>
 #include <QVariantMap>
+#include <QSqlDatabase>
+#include <QHash>
+#include <QStringList>
+#include <QTimer>
+#include <QFuture>
+#include <QtQml/qqmlregistration.h>
+
+class QQmlEngine;
+class QJSEngine;
+class QQuickWindow;
+
+#include "eventbus.h"
+#include "dailytracker.h"
+#include "achievements.h"
+#include "xpledger.h"
+#include "backup.h"
+#include "tablewatch.h"
+#include "responsetimes.h"
+#include "valuetypes.h"
 
 class AppController : public QObject {
     Q_OBJECT
+    QML_NAMED_ELEMENT(App)
+    QML_SINGLETON
 
     Q_PROPERTY(int totalXp READ totalXp NOTIFY totalXpChanged)
     Q_PROPERTY(int level READ level NOTIFY levelChanged)
 
-    Q_PROPERTY(QVariantList quests READ quests NOTIFY questsChanged)
-    Q_PROPERTY(QVariantList dailyTasks READ dailyTasks NOTIFY dailyTasksChanged)
-    Q_PROPERTY(QVariantList leaderboard READ leaderboard NOTIFY leaderboardChanged)
+    Q_PROPERTY(QList<QuestSummary> quests READ quests NOTIFY questsChanged)
+    Q_PROPERTY(QList<DailyTask> dailyTasks READ dailyTasks NOTIFY dailyTasksChanged)
+    Q_PROPERTY(QList<LeaderboardEntry> leaderboard READ leaderboard NOTIFY leaderboardChanged)
+    Q_PROPERTY(QVariantList achievements READ achievements NOTIFY achievementsChanged)
 
     Q_PROPERTY(QString currentUser READ currentUser NOTIFY currentUserChanged)
     Q_PROPERTY(QVariantList users READ users NOTIFY usersChanged)
+    Q_PROPERTY(QString cohort READ cohort NOTIFY cohortChanged)
+    Q_PROPERTY(QStringList backups READ backups NOTIFY backupsChanged)
 
 public:
     explicit AppController(QObject *parent = nullptr);
+    ~AppController() override;
+
+    // QML singleton factory: hands out the instance main() created.
+    static AppController *create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+
+    // First screen's data, read on a worker thread while QML loads.
+    struct StartupData {
+        int userId = -1;
+        QString username;
+        QVariantList users;
+        QList<QuestSummary> quests;
+    };
+    static StartupData loadStartupData(const QString& username);
+    void applyStartupData(const StartupData& data);
+    // Feedback latency and think time are measured against this window's frames.
+    void trackFrames(QQuickWindow *window);
 
     int totalXp() const { return m_totalXp; }
     int level() const { return m_level; }
 
-    QVariantList quests() const { return m_quests; }
-    QVariantList dailyTasks() const { return m_dailyTasks; }
-    QVariantList leaderboard() const { return m_leaderboard; }
+    // Quests, leaderboard and users reload on first read after their
+    // source tables changed (see TableWatch).
+    QList<QuestSummary> quests();
+    QList<DailyTask> dailyTasks() const { return m_dailyTasks; }
+    QList<LeaderboardEntry> leaderboard();
+    QVariantList achievements() const { return m_achievements.list(); }
 
     QString currentUser() const { return m_currentUser; }
-    QVariantList users() const { return m_users; }
+    QVariantList users();
+    QString cohort() const;
+    QStringList backups() const;
 
     Q_INVOKABLE void refresh();
 
     Q_INVOKABLE void completeQuest(int questId, int xpEarned, int score);
-    Q_INVOKABLE QVariantMap getNextQuestion(int questId);
+    Q_INVOKABLE Question getNextQuestion(int questId);
     Q_INVOKABLE bool submitAnswer(int questionId, const QVariant &userAnswer);
     Q_INVOKABLE QString getLesson(int questId);
 
@@ -40,7 +85,31 @@ public:
     Q_INVOKABLE void refreshDaily();
     Q_INVOKABLE void refreshLeaderboard();
 
-    Q_INVOKABLE void setCurrentUser(const QString& username);
+    // Switches to (or creates) a learner. A new learner joins `cohort`
+    // (empty: no cohort); an existing one always opens their own.
+    Q_INVOKABLE void setCurrentUser(const QString& username, const QString& cohort = QString());
+
+    // Merges other machines' progress files from dir, then writes this one's.
+    // An empty dir means ProgressSync::defaultDir(). Runs on a worker; the
+    // outcome arrives as a toast.
+    Q_INVOKABLE void syncProgress(const QString& dir = QString());
+
+    // Moves one student between installs, or hands their history to a grader.
+    // Run on a worker; the outcome and time taken arrive as a toast.
+    Q_INVOKABLE void exportUser(const QString& username, const QString& path);
+    Q_INVOKABLE void importUser(const QString& path);
+
+    // Content-author views; see Analytics for the definitions.
+    Q_INVOKABLE QVariantList questionReport(int questId = -1);
+    Q_INVOKABLE QVariantList questFunnel();
+    Q_INVOKABLE bool exportAnalytics(const QString& dir);
+    // See ResponseTimes: per question (with the slow ones singled out) and
+    // for the current learner.
+    Q_INVOKABLE QVariantMap timingReport();
+    Q_INVOKABLE QVariantMap userTiming();
+
+    Q_INVOKABLE void backupNow();
+    Q_INVOKABLE void restoreBackup(const QString& name);   // name from backups
 
 signals:
     void totalXpChanged();
@@ -48,33 +117,100 @@ signals:
     void questsChanged();
     void dailyTasksChanged();
     void leaderboardChanged();
+    void achievementsChanged();
 
     void currentUserChanged();
     void usersChanged();
+    void cohortChanged();
+    void backupsChanged();
 
     void toast(QString msg);
 
 private:
+    friend class AllocBench;   // measures the query* row builders
+
     void loadStats();
-    void loadQuests();
     void loadDailyTasks();
-    void loadLeaderboard();
-    void loadUsers();
-
-    bool ensureUser(const QString& username);
 
-    int computeLevel(int xp) const;
+    enum Model { QuestsModel = 0x1, LeaderboardModel = 0x2, UsersModel = 0x4 };
+    void markStale(int models);
+    void markWritten(int models);   // after our own write, when no hook reports it
+    void workerWritten(int models); // the same once a worker's writes are done
+    void onTablesChanged(TableWatch::Tables tables, bool foreign);
+
+    static QList<QuestSummary> queryQuests(QSqlDatabase db, int userId);
+    static QList<LeaderboardEntry> queryLeaderboard(QSqlDatabase db);
+    static Question queryNextQuestion(QSqlDatabase db, int userId, int questId, int assumeMasteredId);
+    static QList<DailyTask> dailyRows(const QVector<DailyTracker::Task>& tasks);
+    static QString queryLesson(QSqlDatabase db, int questId);
+    static QVariantList queryUsers(QSqlDatabase db);
+    static int findUserId(QSqlDatabase db, const QString& username);
+
+    // Speculative loading of what the quiz shows next.
+    // Keys are (quest, question assumed answered correctly, or -1 for "as is").
+    struct PrefetchResult {
+        bool ok = false;
+        Question ifCorrect;
+        int nextQuestId = -1;
+        QString nextLesson;
+        Question nextFirst;
+    };
+    static constexpr int kPrefetchLimit = 16;
+    static quint64 prefetchKey(int questId, int afterQuestionId);
+    static PrefetchResult prefetch(int userId, int questId, int questionId);
+    void schedulePrefetch(int questId, int questionId);
+    void invalidatePrefetch();
+    void onAnswerRecorded(int questId, int questionId, bool correct);
+
+    void runMaintenance();
+
+    bool ensureUser(const QString& username, const QString& cohort = QString());
+    void selectUser(int userId, const QString& username);
+
+    bool awardXp(int xp, XpLedger::Source source, int ref = 0);   // appends to ledger + publishes XpAwarded
+    void xpChanged(int newTotal);   // level, XpAwarded and achievements for a new ledger total
+    void trackDaily(DailyTracker::Action action);
 
     int m_totalXp = 0;
     int m_level = 1;
+    int m_publishedLevel = 1;          // last level announced via levelChanged
 
     int m_userId = -1;                 // better default than 1
     QString m_currentUser = "LocalUser";
 
-    QVariantList m_quests;
-    QVariantList m_dailyTasks;
-    QVariantList m_leaderboard;
+    QList<QuestSummary> m_quests;
+    QList<DailyTask> m_dailyTasks;
+    QList<LeaderboardEntry> m_leaderboard;
 
     QVariantList m_users;
+    int m_stale = 0;                   // Model bits to reload on next read
+
+    static AppController *s_instance;
+
+    QHash<quint64, Question> m_prefetched;
+    QHash<int, QString> m_lessonCache;
+    quint64 m_prefetchGen = 0;
+
+    QTimer m_maintenanceTimer;
+    QFuture<Backup::Report> m_maintenance;   // archive + backup worker
+
+    struct ProfileResult {
+        bool ok = false;
+        QString message;   // toast text
+    };
+    QFuture<ProfileResult> m_profileIO;     // profile export/import worker
+
+    struct SyncResult {
+        int imported = 0;   // -1: some file failed
+        int exported = 0;
+        QList<int> touched;
+        qint64 elapsedMs = 0;
+    };
+    QFuture<SyncResult> m_sync;              // progress sync worker
+
+    EventBus m_bus;
+    DailyTracker m_dailies;
+    AchievementEngine m_achievements;
+    ResponseTimes m_timing;
 };
 
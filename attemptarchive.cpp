@@ -0,0 +1,117 @@
+#include "attemptarchive.h"
+#include "Database.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QThread>
+#include <QVariant>
+#include <QDebug>
+#include <QStringList>
+#include <limits>
+
+int AttemptArchive::run() {
+    const qint64 cutoff = Database::now() - qint64(kKeepDays) * 86400;
+
+    // One failing file should not keep the others from archiving.
+    int total = 0;
+    bool failed = false;
+    for (const QString &cohort : QStringList{QString()} + Database::cohorts()) {
+        failed |= !Database::withCohort(cohort, [&](QSqlDatabase db) {
+            const int moved = archiveOlderThan(db, cutoff);
+            total += qMax(moved, 0);
+            return moved >= 0;
+        });
+    }
+    return failed ? -1 : total;
+}
+
+int AttemptArchive::archiveOlderThan(QSqlDatabase db, qint64 cutoff, int batchRows) {
+    if (!db.isOpen()) return -1;
+
+    // A batch copied before a crash is still in the hot table too.
+    if (dropArchived(db, std::numeric_limits<qint64>::max(), cutoff) < 0) return -1;
+
+    int total = 0;
+    for (;;) {
+        const int moved = moveBatch(db, cutoff, batchRows);
+        if (moved < 0) return -1;
+        if (moved == 0) break;
+        total += moved;
+        // Short transactions with a gap between them keep the UI's writes flowing.
+        QThread::msleep(20);
+    }
+    if (total > 0) qInfo() << "Archived" << total << "attempts older than" << cutoff << "from" << db.databaseName();
+    return total;
+}
+
+int AttemptArchive::moveBatch(QSqlDatabase db, qint64 cutoff, int batchRows) {
+    // Two transactions, one file each. With WAL a transaction over both
+    // files commits them separately, main first, so a crash in between
+    // could lose the batch from both. Copy first; delete only what the
+    // archive then holds.
+    if (!Database::begin(db)) return -1;
+
+    // Old rows sit at the low end of the rowid range, so this stops early.
+    QSqlQuery q(db);
+    q.prepare("SELECT MAX(id), COUNT(*) FROM (SELECT id FROM main.attempts WHERE timestamp < ? ORDER BY id LIMIT ?)");
+    q.addBindValue(cutoff);
+    q.addBindValue(batchRows);
+    if (!q.exec() || !q.next()) {
+        qWarning() << "archive: batch scan failed:" << q.lastError().text();
+        db.rollback();
+        return -1;
+    }
+    const qint64 maxId = q.value(0).toLongLong();
+    const int rows = q.value(1).toInt();
+    q.finish();
+    if (rows == 0) {
+        db.rollback();
+        return 0;
+    }
+
+    // OR IGNORE: a batch copied before a crash is not duplicated.
+    QSqlQuery copy(db);
+    copy.prepare(R"(
+        INSERT OR IGNORE INTO archive.attempts(user_id, id, question_id, timestamp, is_correct, answer, origin)
+        SELECT user_id, id, question_id, timestamp, is_correct, answer, origin
+        FROM main.attempts WHERE id <= ? AND timestamp < ?
+    )");
+    copy.addBindValue(maxId);
+    copy.addBindValue(cutoff);
+    if (!copy.exec()) {
+        qWarning() << "archive: copy failed:" << copy.lastError().text();
+        db.rollback();
+        return -1;
+    }
+    if (!db.commit()) {
+        qWarning() << "archive: commit failed:" << db.lastError().text();
+        db.rollback();
+        return -1;
+    }
+
+    // Until this commits the batch is in both tables; attempts_all lists
+    // it twice meanwhile. attempt_summary, which the app reads, is not
+    // affected.
+    return dropArchived(db, maxId, cutoff) < 0 ? -1 : rows;
+}
+
+int AttemptArchive::dropArchived(QSqlDatabase db, qint64 maxId, qint64 cutoff) {
+    int removed = 0;
+    const bool ok = Database::write(db, [&] {
+        QSqlQuery del(db);
+        del.prepare(R"(
+            DELETE FROM main.attempts
+            WHERE id <= ? AND timestamp < ?
+              AND EXISTS(SELECT 1 FROM archive.attempts a
+                         WHERE a.user_id = main.attempts.user_id AND a.id = main.attempts.id)
+        )");
+        del.addBindValue(maxId);
+        del.addBindValue(cutoff);
+        if (!del.exec()) {
+            qWarning() << "archive: delete failed:" << del.lastError().text();
+            return false;
+        }
+        removed = del.numRowsAffected();
+        return true;
+    }, "archive: drop moved attempts");
+    return ok ? removed : -1;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <QSqlDatabase>
+
+// Moves old attempts from the hot database into the attached archive file.
+// Per-question counts stay in attempt_summary, so nothing the quiz reads
+// changes; full history is the attempts_all view over both tables.
+class AttemptArchive {
+public:
+    static constexpr int kKeepDays = 120;     // attempts younger than this stay hot
+    static constexpr int kBatchRows = 2000;   // rows per write transaction
+
+    // Archives attempts older than kKeepDays in the shared file and every
+    // cohort shard, open or not; safe to call from a worker thread.
+    // Returns the number of rows moved, or -1 if any file failed.
+    static int run();
+    static int archiveOlderThan(QSqlDatabase db, qint64 cutoff, int batchRows = kBatchRows);
+
+private:
+    static int moveBatch(QSqlDatabase db, qint64 cutoff, int batchRows);
+    // Deletes hot rows the archive already holds; rows removed, or -1.
+    static int dropArchived(QSqlDatabase db, qint64 maxId, qint64 cutoff);
+};
@@ -0,0 +1,456 @@
+#include "backup.h"
+#include "Database.h"
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <QRegularExpression>
+#include <sqlite3.h>
+
+namespace {
+
+const char kTimeFormat[] = "yyyyMMdd-HHmmss";
+const char kPartial[] = ".partial";
+
+} // namespace
+
+QString Backup::backupDir() {
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/backups";
+    QDir().mkpath(dir);
+    return dir;
+}
+
+QStringList Backup::snapshots() {
+    QStringList names = QDir(backupDir()).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name | QDir::Reversed);
+    names.removeIf([](const QString& n) { return n.endsWith(QLatin1String(kPartial)); });
+    return names;
+}
+
+bool Backup::isDue() {
+    const QStringList names = snapshots();
+    if (names.isEmpty()) return true;
+    const QDateTime last = QDateTime::fromString(names.first(), QString::fromLatin1(kTimeFormat));
+    return !last.isValid() || last.secsTo(QDateTime::currentDateTime()) >= qint64(kIntervalHours) * 3600;
+}
+
+QList<Backup::Group> Backup::groups(const QStringList& cohorts) {
+    // Shards before the shared file: users rows are committed before any
+    // shard row refers to them, so a later copy of the shared file holds
+    // every learner the shards mention.
+    QList<Group> out;
+    for (const QString &cohort : cohorts + QStringList{QString()}) {
+        Group g{cohort, {{QStringLiteral("main"), cohort.isEmpty() ? Database::dbPath() : Database::cohortPath(cohort)}}};
+        const QString archive = Database::archivePath(cohort);
+        if (QFileInfo::exists(archive)) g.files.append({QStringLiteral("archive"), archive});
+        out.append(g);
+    }
+    return out;
+}
+
+bool Backup::copyFiles(const Group& g, const QString& destDir, Report& r) {
+    // A second SQLite in the process must not open live files: closing its
+    // connection drops the POSIX locks the driver's connections hold.
+    if (!Database::nativeApi()) return vacuumFiles(g, destDir, r);
+
+    // Our own connection on the same files, of the same library as the
+    // driver's: the backup API is then always called on a handle we link.
+    const Files &files = g.files;
+    sqlite3* src = nullptr;
+    auto fail = [&](const QString& what) {
+        r.error = what + ": " + QString::fromUtf8(sqlite3_errmsg(src));
+        sqlite3_exec(src, "ROLLBACK", nullptr, nullptr, nullptr);
+        sqlite3_close(src);
+        return false;
+    };
+    auto exec = [&](const QString& sql) {
+        return sqlite3_exec(src, sql.toUtf8().constData(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    };
+
+    if (sqlite3_open_v2(QFile::encodeName(files.first().second).constData(), &src,
+                        SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK)
+        return fail("main");
+    sqlite3_busy_timeout(src, Database::kBusyTimeoutMs);
+
+    for (qsizetype i = 1; i < files.size(); ++i) {
+        sqlite3_stmt* st = nullptr;
+        const QByteArray sql = "ATTACH DATABASE ? AS " + files[i].first.toUtf8();
+        const QByteArray path = QFile::encodeName(files[i].second);
+        const bool ok = sqlite3_prepare_v2(src, sql.constData(), -1, &st, nullptr) == SQLITE_OK
+                        && sqlite3_bind_text(st, 1, path.constData(), -1, SQLITE_TRANSIENT) == SQLITE_OK
+                        && sqlite3_step(st) == SQLITE_DONE;
+        sqlite3_finalize(st);
+        if (!ok) return fail(files[i].first);
+    }
+
+    // A read of each file opens its read transaction, all before the first
+    // page is copied. Each copy is then one step of that same snapshot:
+    // nothing restarts it, and writers keep going meanwhile.
+    if (!exec("BEGIN")) return fail("begin");
+    for (const auto &[schema, file] : files) {
+        if (!exec(QString("SELECT count(*) FROM %1.sqlite_master").arg(schema))) return fail(schema);
+    }
+    for (const auto &[schema, file] : files) {
+        const QString dest = QDir(destDir).filePath(QFileInfo(file).fileName());
+        if (!copySchema(src, schema, dest, r)) {
+            r.error = schema + ": " + r.error;
+            sqlite3_exec(src, "ROLLBACK", nullptr, nullptr, nullptr);
+            sqlite3_close(src);
+            return false;
+        }
+    }
+    exec("COMMIT");
+    sqlite3_close(src);
+    return true;
+}
+
+bool Backup::vacuumFiles(const Group& g, const QString& destDir, Report& r) {
+    // VACUUM INTO runs outside a transaction, so each file is its own
+    // moment: main before archive. Attempts reach the archive before they
+    // leave main (AttemptArchive), so none is missed; one in both is
+    // cleared by the next archive run.
+    return Database::withCohort(g.cohort, [&](QSqlDatabase db) {
+        QSqlQuery q(db);
+        for (const auto &[schema, file] : g.files) {
+            if (q.exec(QString("PRAGMA %1.page_count").arg(schema)) && q.next()) r.pages += q.value(0).toInt();
+            q.prepare(QString("VACUUM %1 INTO ?").arg(schema));
+            q.addBindValue(QDir(destDir).filePath(QFileInfo(file).fileName()));
+            if (!q.exec()) {
+                r.error = schema + ": " + q.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool Backup::copySchema(sqlite3* src, const QString& schema, const QString& destPath, Report& r) {
+    sqlite3* dest = nullptr;
+    if (sqlite3_open_v2(QFile::encodeName(destPath).constData(), &dest,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+        r.error = QString::fromUtf8(sqlite3_errmsg(dest));
+        sqlite3_close(dest);
+        return false;
+    }
+
+    sqlite3_backup* b = sqlite3_backup_init(dest, "main", src, schema.toUtf8().constData());
+    if (!b) {
+        r.error = QString::fromUtf8(sqlite3_errmsg(dest));
+        sqlite3_close(dest);
+        return false;
+    }
+
+    const int rc = sqlite3_backup_step(b, -1);
+    r.pages += sqlite3_backup_pagecount(b);
+    sqlite3_backup_finish(b);
+    if (rc != SQLITE_DONE) r.error = QString::fromUtf8(sqlite3_errstr(rc));
+    sqlite3_close(dest);
+    return rc == SQLITE_DONE;
+}
+
+bool Backup::copyTables(QSqlDatabase db, const QString& live, const QString& snap, QString* error) {
+    // The live schema becomes the snapshot's first: a shard nobody opened
+    // since an upgrade still has older tables.
+    {
+        static const QRegularExpression create(QStringLiteral("^CREATE (TABLE|INDEX|UNIQUE INDEX) "));
+        QSqlQuery ddl(db), have(db), q(db);
+        have.prepare(QString("SELECT sql FROM %1.sqlite_master WHERE type = ? AND name = ?").arg(live));
+        // Tables sort before their indexes.
+        if (!ddl.exec(QString(R"(
+                SELECT type, name, sql FROM %1.sqlite_master
+                WHERE type IN ('table', 'index') AND sql IS NOT NULL AND name NOT LIKE 'sqlite_%'
+                ORDER BY type DESC
+            )").arg(snap))) {
+            *error = snap + ": " + ddl.lastError().text();
+            return false;
+        }
+        while (ddl.next()) {
+            const QString type = ddl.value(0).toString(), name = ddl.value(1).toString();
+            QString sql = ddl.value(2).toString();
+            have.bindValue(0, type);
+            have.bindValue(1, name);
+            if (!have.exec()) {
+                *error = name + ": " + have.lastError().text();
+                return false;
+            }
+            const bool exists = have.next();
+            if (exists && (type == QLatin1String("index") || have.value(0).toString() == sql)) continue;
+            have.finish();
+
+            bool ok = !exists || q.exec(QString("DROP TABLE %1.%2").arg(live, name));
+            ok = ok && q.exec(sql.replace(create, QStringLiteral("CREATE \\1 ") + live + '.'));
+            if (!ok) {
+                *error = name + ": " + q.lastError().text();
+                return false;
+            }
+        }
+    }
+
+    auto tableNames = [&](const QString& schema, QStringList& out) {
+        QSqlQuery q(db);
+        if (!q.exec(QString("SELECT name FROM %1.sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%'")
+                        .arg(schema))) {
+            *error = schema + ": " + q.lastError().text();
+            return false;
+        }
+        while (q.next()) out << q.value(0).toString();
+        return true;
+    };
+    auto columns = [&](const QString& schema, const QString& table) {
+        QStringList out;
+        QSqlQuery q(db);
+        if (q.exec(QString("PRAGMA %1.table_info(%2)").arg(schema, table))) {
+            while (q.next()) out << q.value(1).toString();
+        }
+        return out;
+    };
+
+    QSqlQuery q(db);
+    QStringList liveTables, snapTables;
+    if (!tableNames(live, liveTables) || !tableNames(snap, snapTables)) return false;
+    for (const QString &t : snapTables) {
+        if (!liveTables.contains(t)) {
+            *error = live + ": no table " + t;
+            return false;
+        }
+    }
+
+    for (const QString &t : liveTables) {
+        if (!q.exec(QString("DELETE FROM %1.%2").arg(live, t))) {
+            *error = t + ": " + q.lastError().text();
+            return false;
+        }
+        if (!snapTables.contains(t)) continue;
+
+        const QStringList snapColumns = columns(snap, t);
+        QStringList shared = columns(live, t);
+        shared.removeIf([&](const QString& c) { return !snapColumns.contains(c); });
+        const QString list = shared.join(", ");
+        if (!q.exec(QString("INSERT INTO %1.%2(%3) SELECT %3 FROM %4.%2").arg(live, t, list, snap))) {
+            *error = t + ": " + q.lastError().text();
+            return false;
+        }
+    }
+
+    // AUTOINCREMENT counters only move forward: ids handed out since the
+    // snapshot (say to a learner in another cohort) are never reused.
+    QSqlQuery seq(db);
+    seq.exec(QString("SELECT 1 FROM %1.sqlite_master WHERE name = 'sqlite_sequence'").arg(snap));
+    if (seq.next() && !q.exec(QString(R"(
+            UPDATE %1.sqlite_sequence SET seq = MAX(seq, COALESCE(
+                (SELECT s.seq FROM %2.sqlite_sequence s WHERE s.name = sqlite_sequence.name), 0))
+        )").arg(live, snap))) {
+        *error = "sqlite_sequence: " + q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool Backup::verify(const QString& path, QString* error, int* stamp) {
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(QFile::encodeName(path).constData(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        if (error) *error = QString::fromUtf8(sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    auto single = [db](const char* sql, QString& text) {
+        sqlite3_stmt* st = nullptr;
+        bool ok = sqlite3_prepare_v2(db, sql, -1, &st, nullptr) == SQLITE_OK && sqlite3_step(st) == SQLITE_ROW;
+        if (ok) text = QString::fromUtf8(reinterpret_cast<const char*>(sqlite3_column_text(st, 0)));
+        sqlite3_finalize(st);
+        return ok;
+    };
+
+    QString result, version;
+    const bool ok = single("PRAGMA integrity_check", result) && result == QLatin1String("ok")
+                    && single("PRAGMA user_version", version);
+    if (!ok && error) *error = result.isEmpty() ? QString::fromUtf8(sqlite3_errmsg(db)) : result;
+    if (ok && stamp) *stamp = version.toInt();
+    sqlite3_close(db);
+    return ok;
+}
+
+void Backup::rotate() {
+    const QStringList names = snapshots();
+    for (int i = kKeepSnapshots; i < names.size(); ++i)
+        QDir(QDir(backupDir()).filePath(names[i])).removeRecursively();
+}
+
+Backup::Report Backup::snapshot() {
+    Report r;
+    QElapsedTimer total;
+    total.start();
+
+    r.name = QDateTime::currentDateTime().toString(QString::fromLatin1(kTimeFormat));
+    const QDir root(backupDir());
+    const QString partial = root.filePath(r.name + kPartial);
+    Database::takePeakWaitMs();
+    const quint64 retries = Database::contention().retries;
+    QDir(partial).removeRecursively();
+    QDir().mkpath(partial);
+
+    // All files land next to each other; names stay apart (see cohortPath).
+    bool ok = true;
+    for (const Group &g : groups(Database::cohorts())) {
+        ok = copyFiles(g, partial, r);
+        for (const auto &[schema, file] : g.files) {
+            if (!ok) break;
+            const QString dest = QDir(partial).filePath(QFileInfo(file).fileName());
+            ok = verify(dest, &r.error);
+            if (!ok) r.error = QFileInfo(file).fileName() + ": " + r.error;
+            else r.bytes += QFileInfo(dest).size();
+        }
+        if (!ok) break;
+    }
+
+    if (ok && !QDir().rename(partial, root.filePath(r.name))) {
+        r.error = "cannot finalize " + partial;
+        ok = false;
+    }
+    if (!ok) QDir(partial).removeRecursively();
+    else rotate();
+
+    r.ok = ok;
+    r.elapsedMs = total.elapsed();
+    r.writerRetries = Database::contention().retries - retries;
+    r.maxStallMs = Database::takePeakWaitMs();
+    if (ok) {
+        qInfo() << "backup:" << r.name << r.bytes << "bytes," << r.pages << "pages in" << r.elapsedMs << "ms;"
+                << "writers retried" << r.writerRetries << "times, longest wait" << r.maxStallMs << "ms";
+    } else {
+        qWarning() << "backup failed:" << r.error;
+    }
+    return r;
+}
+
+bool Backup::restoreGroup(const Group& g, const QDir& from, QString* error) {
+    // Row copies through a live connection, so one transaction covers the
+    // shard and its archive: a failure in either rolls both back, and
+    // other connections see ordinary writes instead of pages changing
+    // under them. Rows come verbatim from a consistent state; foreign keys
+    // are off meanwhile, as for migrations.
+    return Database::withCohort(g.cohort, [&](QSqlDatabase db) {
+        QStringList attached;
+        bool ok = true;
+        for (const auto &[schema, file] : g.files) {
+            QSqlQuery attach(db);
+            attach.prepare(QString("ATTACH DATABASE ? AS restore_%1").arg(attached.size()));
+            attach.addBindValue(from.filePath(QFileInfo(file).fileName()));
+            if (!attach.exec()) {
+                *error = schema + ": " + attach.lastError().text();
+                ok = false;
+                break;
+            }
+            attached << QString("restore_%1").arg(attached.size());
+        }
+
+        if (ok) {
+            QSqlQuery fk(db);
+            fk.exec("PRAGMA foreign_keys = OFF");
+            ok = Database::write(db, [&] {
+                for (qsizetype i = 0; i < g.files.size(); ++i) {
+                    if (!copyTables(db, g.files[i].first, attached[i], error)) return false;
+                }
+                // The stamp comes along: prepareShard() upgrades an old one.
+                QSqlQuery stamp(db);
+                return stamp.exec("PRAGMA restore_0.user_version") && stamp.next()
+                       && stamp.exec(QString("PRAGMA main.user_version = %1").arg(stamp.value(0).toInt()));
+            }, "restore backup");
+            fk.exec("PRAGMA foreign_keys = ON");
+        }
+
+        for (const QString &schema : attached) {
+            QSqlQuery detach(db);
+            detach.exec("DETACH DATABASE " + schema);
+        }
+        if (!ok && error->isEmpty()) *error = QStringLiteral("database busy");
+        return ok;
+    });
+}
+
+bool Backup::restore(const QString& name, QString* error) {
+    QString why;
+    auto fail = [&](const QString& msg) {
+        qWarning() << "restore failed:" << msg;
+        if (error) *error = msg;
+        return false;
+    };
+
+    const QDir dir(QDir(backupDir()).filePath(name));
+    if (name.isEmpty() || name.endsWith(QLatin1String(kPartial)) || !dir.exists())
+        return fail("no snapshot " + name);
+
+    // Check everything before touching anything. The live side of each
+    // group is what exists now; the snapshot side what the snapshot has
+    // (an archive made since is left alone).
+    const QList<Group> live = groups(Database::cohorts(dir.absolutePath()));
+    QList<Group> from = live;
+    for (Group &g : from) {
+        g.files.resize(1);
+        const QString archive = Database::archivePath(g.cohort);
+        if (QFileInfo::exists(dir.filePath(QFileInfo(archive).fileName())))
+            g.files.append({QStringLiteral("archive"), archive});
+
+        for (const auto &[schema, file] : g.files) {
+            const QString fileName = QFileInfo(file).fileName();
+            int stamp = 0;
+            if (!QFileInfo::exists(dir.filePath(fileName))) return fail(fileName + " missing from snapshot");
+            if (!verify(dir.filePath(fileName), &why, &stamp)) return fail(fileName + ": " + why);
+            if (schema != QLatin1String("main")) continue;
+            // A shard may lag (not opened since an upgrade); the shared file may not.
+            if (g.cohort.isEmpty() ? stamp != Database::currentStamp() : stamp > Database::currentStamp())
+                return fail("snapshot is from another schema version");
+        }
+    }
+
+    // Each shard's current contents go aside first, so a failure further
+    // on can put back the ones already replaced.
+    const QDir undo(backupDir() + "/.restore-undo");
+    QDir(undo).removeRecursively();
+    QDir().mkpath(undo.absolutePath());
+
+    QList<Group> done;
+    QStringList created;
+    bool ok = true;
+    for (qsizetype i = 0; ok && i < from.size(); ++i) {
+        const Group &g = from[i];
+        if (!QFileInfo::exists(g.files.first().second)) {
+            // Nothing has a file open that does not exist: copy it in whole.
+            for (const auto &[schema, file] : g.files) {
+                ok = QFile::copy(dir.filePath(QFileInfo(file).fileName()), file);
+                if (!ok) {
+                    why = "cannot create " + file;
+                    break;
+                }
+                created << file;
+            }
+            continue;
+        }
+        Report saved;
+        ok = copyFiles(live[i], undo.absolutePath(), saved);
+        if (!ok) why = "cannot save current " + g.files.first().second + ": " + saved.error;
+        ok = ok && restoreGroup(g, dir, &why);
+        if (ok) done.append(live[i]);
+    }
+
+    if (!ok) {
+        for (const Group &g : std::as_const(done)) {
+            QString undoError;
+            if (!restoreGroup(g, undo, &undoError))
+                qWarning() << "restore: cannot put back" << g.files.first().second << undoError
+                           << "- its previous contents are in" << undo.absolutePath();
+        }
+        for (const QString &file : std::as_const(created)) QFile::remove(file);
+        return fail(why);
+    }
+
+    QDir(undo).removeRecursively();
+    qInfo() << "restored snapshot" << name;
+    return true;
+}
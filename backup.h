@@ -0,0 +1,67 @@
+#pragma once
+#include <QSqlDatabase>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+struct sqlite3;
+class QDir;
+
+// Online snapshots of every database file, the shared one and every
+// cohort's shard with their archives, whether or not the cohort is open.
+// When the driver's SQLite is the one we link (Database::nativeApi()), a
+// shard and its archive are copied through the backup API inside one read
+// transaction, so they show the same moment. Otherwise only the driver's
+// own connections touch live files and each is copied with VACUUM INTO.
+// In WAL mode writers are not held up either way. Snapshots are
+// integrity-checked before they count, live in <AppData>/backups/<time>/
+// and are rotated.
+class Backup {
+public:
+    struct Report {
+        bool ok = false;
+        QString name;            // snapshot directory, yyyyMMdd-HHmmss
+        QString error;
+        qint64 bytes = 0;
+        int pages = 0;
+        qint64 elapsedMs = 0;
+        // Writers in this process while it ran: lock retries and the
+        // longest wait for the lock (worst stall).
+        quint64 writerRetries = 0;
+        qint64 maxStallMs = 0;
+    };
+
+    static constexpr int kKeepSnapshots = 7;
+    static constexpr int kIntervalHours = 24;
+
+    static QString backupDir();
+    static QStringList snapshots();   // newest first
+    static bool isDue();
+
+    // Safe to call from a worker thread; rotates old snapshots on success.
+    static Report snapshot();
+    // Replaces the live contents of every file in the snapshot with the
+    // snapshot's, one transaction per shard; if one fails, those already
+    // replaced are put back. Cohorts made since keep their files, but the
+    // restored shared file no longer lists their learners.
+    // Safe to call from a worker thread; nothing may run a transaction on
+    // that thread's connection meanwhile.
+    static bool restore(const QString& name, QString* error);
+
+private:
+    using Files = QList<QPair<QString, QString>>;   // (schema, file), main first
+    struct Group {
+        QString cohort;   // "" = the shared file
+        Files files;      // main and, if it exists, archive
+    };
+
+    static QList<Group> groups(const QStringList& cohorts);   // cohorts first, shared last
+    static bool restoreGroup(const Group& g, const QDir& from, QString* error);
+    static bool copyFiles(const Group& g, const QString& destDir, Report& r);
+    static bool vacuumFiles(const Group& g, const QString& destDir, Report& r);
+    static bool copySchema(sqlite3* src, const QString& schema, const QString& destPath, Report& r);
+    static bool copyTables(QSqlDatabase db, const QString& live, const QString& snap, QString* error);
+    static bool verify(const QString& path, QString* error, int* stamp = nullptr);
+    static void rotate();
+};
@@ -0,0 +1,184 @@
+#include "dailytracker.h"
+#include "Database.h"
+#include "xpledger.h"
+#include <QDateTime>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+DailyTracker::DailyTracker(QObject *parent) : QObject(parent) {
+    m_midnight.setSingleShot(true);
+    connect(&m_midnight, &QTimer::timeout, this, [this] {
+        reload();
+        emit dayRolledOver();
+    });
+}
+
+void DailyTracker::setUser(int userId) {
+    m_userId = userId;
+    reload();
+}
+
+const DailyTracker::Task* DailyTracker::task(int taskId) const {
+    for (const auto &t : m_tasks)
+        if (t.id == taskId) return &t;
+    return nullptr;
+}
+
+void DailyTracker::reload() {
+    m_day = Database::today();
+    m_tasks.clear();
+    for (auto &v : m_byAction) v.clear();
+
+    QSqlQuery q(Database::db());
+    q.prepare(R"(
+        SELECT dt.id, dt.title, dt.xp_value, dt.action, dt.target,
+               COALESCE(dp.count, 0) AS progress,
+               dc.task_id IS NOT NULL AS done_today
+        FROM daily_tasks dt
+        LEFT JOIN daily_progress dp
+          ON dp.user_id = ? AND dp.task_id = dt.id AND dp.day = ?
+        LEFT JOIN daily_completions dc
+          ON dc.user_id = ? AND dc.task_id = dt.id AND dc.day = ?
+        WHERE dt.active = 1
+        ORDER BY dt.id ASC
+    )");
+    q.addBindValue(m_userId);
+    q.addBindValue(m_day);
+    q.addBindValue(m_userId);
+    q.addBindValue(m_day);
+
+    if (!q.exec()) {
+        qWarning() << "DailyTracker reload failed:" << q.lastError().text();
+    } else {
+        while (q.next()) {
+            Task t;
+            t.id = q.value(0).toInt();
+            t.title = q.value(1).toString();
+            t.xp = q.value(2).toInt();
+            const int action = q.value(3).toInt();
+            t.action = (action > Manual && action < ActionCount) ? Action(action) : Manual;
+            t.target = qMax(1, q.value(4).toInt());
+            t.count = q.value(5).toInt();
+            t.done = q.value(6).toInt() == 1;
+            m_byAction[t.action].append(m_tasks.size());
+            m_tasks.append(t);
+        }
+    }
+
+    scheduleRollover();
+}
+
+void DailyTracker::ensureToday() {
+    // The timer may be late after sleep/hibernate; never count into yesterday.
+    if (m_day != Database::today()) {
+        reload();
+        emit dayRolledOver();
+    }
+}
+
+void DailyTracker::scheduleRollover() {
+    const QDateTime now = QDateTime::currentDateTime();
+    const QDateTime midnight(now.date().addDays(1), QTime(0, 0));
+    m_midnight.start(qMax<qint64>(1000, now.msecsTo(midnight) + 1000));
+}
+
+QVector<DailyTracker::Task> DailyTracker::record(Action action, int& xpTotal) {
+    xpTotal = -1;
+    QVector<Task> completed;
+    if (m_userId <= 0 || action <= Manual || action >= ActionCount) return completed;
+
+    ensureToday();
+
+    // The cache only changes once the transaction has committed; a retried
+    // unit starts over. Completion goes by the stored count, which also
+    // holds what other instances counted for this learner today.
+    QSqlDatabase db = Database::db();
+    QVector<QPair<int, int>> counted;   // (task index, stored count)
+    QVector<int> finished;
+    const bool ok = Database::write(db, [&] {
+        counted.clear();
+        finished.clear();
+        completed.clear();
+        xpTotal = -1;
+
+        QSqlQuery up(db), count(db);
+        up.prepare(R"(
+            INSERT INTO daily_progress(user_id, task_id, day, count)
+            VALUES(?, ?, ?, 1)
+            ON CONFLICT(user_id, task_id, day) DO UPDATE SET count = count + 1
+        )");
+        count.prepare("SELECT count FROM daily_progress WHERE user_id = ? AND task_id = ? AND day = ?");
+        for (int idx : m_byAction[action]) {
+            const Task &t = m_tasks[idx];
+            if (t.done) continue;
+
+            for (QSqlQuery *q : {&up, &count}) {
+                q->bindValue(0, m_userId);
+                q->bindValue(1, t.id);
+                q->bindValue(2, m_day);
+                if (!q->exec()) {
+                    qWarning() << "daily progress update failed:" << q->lastError().text();
+                    return false;
+                }
+            }
+            if (!count.next()) return false;
+            const int stored = count.value(0).toInt();
+            count.finish();
+            counted.append({idx, stored});
+            if (stored < t.target) continue;
+
+            bool first = false;
+            if (!markCompleted(db, t, first, xpTotal)) return false;
+            finished.append(idx);
+            if (first) {
+                Task done = t;
+                done.count = stored;
+                done.done = true;
+                completed.append(done);
+            }
+        }
+        return true;
+    }, "daily progress");
+    if (!ok) return {};
+
+    for (const auto &[idx, stored] : std::as_const(counted)) m_tasks[idx].count = stored;
+    for (int idx : finished) m_tasks[idx].done = true;
+    return completed;
+}
+
+bool DailyTracker::completeManual(int taskId, int& xpTotal) {
+    xpTotal = -1;
+    ensureToday();
+
+    for (auto &t : m_tasks) {
+        if (t.id != taskId) continue;
+        if (t.done || t.action != Manual) return false;
+
+        bool first = false;
+        QSqlDatabase db = Database::db();
+        if (!Database::write(db, [&] { return markCompleted(db, t, first, xpTotal); }, "daily completion"))
+            return false;
+        t.done = true;
+        return first;
+    }
+    return false;
+}
+
+bool DailyTracker::markCompleted(QSqlDatabase db, const Task &t, bool &first, int &xpTotal) {
+    QSqlQuery ins(db);
+    ins.prepare("INSERT OR IGNORE INTO daily_completions(user_id, task_id, day) VALUES(?, ?, ?)");
+    ins.addBindValue(m_userId);
+    ins.addBindValue(t.id);
+    ins.addBindValue(m_day);
+    if (!ins.exec()) {
+        qWarning() << "daily completion insert failed:" << ins.lastError().text();
+        return false;
+    }
+
+    // Another instance may have completed it first; only award once.
+    first = ins.numRowsAffected() > 0;
+    if (!first || t.xp <= 0) return true;
+    return (xpTotal = XpLedger::appendIn(db, m_userId, XpLedger::Daily, t.xp, t.id)) >= 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <QObject>
+#include <QSqlDatabase>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <array>
+
+// Daily tasks as rules over gameplay actions.
+// Today's tasks and counters for the current user are cached in memory;
+// each action touches only the tasks listening for it and writes one
+// counter row. A counter reaching its target, the completion and its XP
+// commit in the same transaction. The cache rolls over at local midnight.
+class DailyTracker : public QObject {
+    Q_OBJECT
+public:
+    enum Action {
+        Manual = 0,            // completed by pressing a button
+        AnswerSubmitted = 1,
+        QuestCompleted = 2,
+        LessonOpened = 3,
+        ActionCount
+    };
+
+    struct Task {
+        int id = -1;
+        QString title;
+        int xp = 0;
+        Action action = Manual;
+        int target = 1;
+        int count = 0;
+        bool done = false;
+    };
+
+    explicit DailyTracker(QObject *parent = nullptr);
+
+    void setUser(int userId);
+    const QVector<Task>& tasks() const { return m_tasks; }
+    const Task* task(int taskId) const;
+
+    // Counts one occurrence of the action; returns the tasks it completed.
+    // xpTotal receives the user's XP total after their award, or -1 if
+    // nothing was awarded. Nothing is counted if the write fails.
+    QVector<Task> record(Action action, int& xpTotal);
+    // Completes a manual task and awards its XP; false if unknown, already
+    // done, not manual or not saved (then see Database::lastWriteBusy()).
+    bool completeManual(int taskId, int& xpTotal);
+
+signals:
+    void dayRolledOver();
+
+private:
+    void reload();
+    void ensureToday();
+    void scheduleRollover();
+    // Inserts today's completion and, if it is new, appends the task's XP.
+    bool markCompleted(QSqlDatabase db, const Task &t, bool &first, int &xpTotal);
+
+    int m_userId = -1;
+    qint64 m_day = 0;                               // local Julian day
+    QVector<Task> m_tasks;
+    std::array<QVector<int>, ActionCount> m_byAction;   // indices into m_tasks
+    QTimer m_midnight;
+};
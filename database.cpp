@@ -1,6 +1,18 @@
 #include "database.h"
+#include "analytics.h"
+#include "tablewatch.h"
 #include <QStandardPaths>
 #include <QDir>
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QRandomGenerator>
+#include <QDate>
+#include <QDateTime>
+#include <QThread>
+#include <QCoreApplication>
+#include <QSqlDriver>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
@@ -8,23 +20,254 @@
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <sqlite3.h>
+#include <atomic>
 
 QSqlDatabase Database::s_db;
 
+namespace {
+
+struct ContentionCounters {
+    std::atomic<quint64> transactions{0};
+    std::atomic<quint64> retries{0};
+    std::atomic<quint64> failures{0};
+    std::atomic<qint64> waitMs{0};
+    std::atomic<qint64> maxWaitMs{0};
+    std::atomic<qint64> peakWaitMs{0};   // since the last takePeakWaitMs()
+} s_contention;
+
+void raiseTo(std::atomic<qint64>& to, qint64 ms) {
+    qint64 seen = to.load();
+    while (ms > seen && !to.compare_exchange_weak(seen, ms)) {}
+}
+
+void recordWait(qint64 ms) {
+    s_contention.waitMs += ms;
+    raiseTo(s_contention.maxWaitMs, ms);
+    raiseTo(s_contention.peakWaitMs, ms);
+}
+
+// Which cohort the main connection has open. Written on the main thread,
+// read by workers deciding whether their connection is stale.
+QMutex s_layoutLock;
+QString s_cohort;
+std::atomic<int> s_generation{0};
+
+// Set once in init(), before any worker connection exists.
+std::atomic<bool> s_nativeApi{false};
+
+QString cohortDir() {
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/cohorts";
+    QDir().mkpath(dir);
+    return dir;
+}
+
+std::atomic<bool> s_interactive{false};
+thread_local bool t_lastBusy = false;
+
+// False once the deadline has passed: give up instead of sleeping.
+bool backoff(int attempt, const QDeadlineTimer& deadline) {
+    // Jitter keeps retrying instances from colliding in lockstep.
+    const int ms = Database::kBackoffMs << qMin(attempt, 10);
+    const qint64 left = deadline.remainingTime();
+    if (left == 0) return false;
+    QThread::msleep(qMin<qint64>(ms / 2 + QRandomGenerator::global()->bounded(ms / 2 + 1), left));
+    return !deadline.hasExpired();
+}
+
+} // namespace
+
 QString Database::dbPath() {
     const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir().mkpath(dir);
     return dir + "/codeleveling.sqlite";
 }
 
+QString Database::archivePath() {
+    return archivePath(currentCohort());
+}
+
+QString Database::archivePath(const QString& cohort) {
+    if (!cohort.isEmpty()) return cohortPath(cohort + ".archive");
+
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(dir);
+    return dir + "/codeleveling-archive.sqlite";
+}
+
+QString Database::cohortPath(const QString& cohort) {
+    // The prefix keeps shard names apart from the shared files in backups.
+    return cohortDir() + "/cohort-" + cohort + ".sqlite";
+}
+
+QStringList Database::cohorts(const QString& in) {
+    QStringList out;
+    const QDir dir(in.isEmpty() ? cohortDir() : in);
+    for (const QString &file : dir.entryList({QStringLiteral("cohort-*.sqlite")}, QDir::Files, QDir::Name)) {
+        // cohort-<name>.sqlite; archives are cohort-<name>.archive.sqlite
+        const QString name = file.mid(7, file.size() - 7 - 7);
+        if (isValidCohort(name)) out << name;
+    }
+    return out;
+}
+
+QString Database::mainPath() {
+    const QString cohort = currentCohort();
+    return cohort.isEmpty() ? dbPath() : cohortPath(cohort);
+}
+
 QSqlDatabase Database::db() { return s_db; }
 
+QSqlDatabase Database::threadDb() {
+    if (QThread::currentThread() == QCoreApplication::instance()->thread()) return s_db;
+
+    // QSqlDatabase connections are per thread; give each worker its own,
+    // dropped when the thread ends. Pool threads come and go, and a new
+    // thread may get an old one's id: it must not find that connection.
+    struct Connection {
+        QString name;
+        int generation = -1;
+        ~Connection() {
+            if (!name.isEmpty()) QSqlDatabase::removeDatabase(name);
+        }
+    };
+    thread_local Connection conn;
+    QSqlDatabase db;
+    if (!conn.name.isEmpty()) {
+        db = QSqlDatabase::database(conn.name);
+        if (conn.generation == s_generation) return db;
+        // The main connection moved to another cohort since; follow it.
+        db.close();
+    } else {
+        conn.name = QStringLiteral("codeleveling-%1").arg(quintptr(QThread::currentThreadId()));
+        db = QSqlDatabase::cloneDatabase(QStringLiteral("codeleveling"), conn.name);
+    }
+
+    conn.generation = s_generation;
+    const QString cohort = currentCohort();
+    db.setDatabaseName(cohort.isEmpty() ? dbPath() : cohortPath(cohort));
+    if (!db.open()) {
+        qWarning() << "DB open failed on worker thread:" << db.lastError().text();
+        return db;
+    }
+    configure(db, cohort);
+    return db;
+}
+
+bool Database::withCohort(const QString& cohort, const std::function<bool(QSqlDatabase)>& work) {
+    if (cohort == currentCohort()) return work(threadDb());
+
+    const QString name = QStringLiteral("codeleveling-%1-cohort-%2")
+                             .arg(quintptr(QThread::currentThreadId())).arg(cohort);
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::cloneDatabase(QStringLiteral("codeleveling"), name);
+        db.setDatabaseName(cohort.isEmpty() ? dbPath() : cohortPath(cohort));
+        if (db.open()) {
+            configure(db, cohort);
+            ok = work(db);
+            db.close();
+        } else {
+            qWarning() << "DB open failed for cohort" << cohort << db.lastError().text();
+        }
+    }
+    QSqlDatabase::removeDatabase(name);
+    return ok;
+}
+
+void Database::configure(QSqlDatabase db, const QString& cohort) {
+    // IMPORTANT: do this after open()
+    TableWatch::install(db);
+
+    QSqlQuery pragma(db);
+    if (!pragma.exec("PRAGMA foreign_keys = ON;")) {
+        qWarning() << "Failed to enable foreign keys:" << pragma.lastError().text();
+    }
+    if (!pragma.exec(QStringLiteral("PRAGMA busy_timeout = %1").arg(busyTimeoutMs(db)))) {
+        qWarning() << "Failed to set busy timeout:" << pragma.lastError().text();
+    }
+    // Persistent in the file; readers no longer block writers or vice versa.
+    if (!pragma.exec("PRAGMA journal_mode = WAL") || !pragma.next()
+        || pragma.value(0).toString() != QLatin1String("wal")) {
+        qWarning() << "Failed to enable WAL:" << pragma.lastError().text();
+    }
+
+    // Cold attempts live in a separate file; every connection sees them and
+    // history queries read the attempts_all view instead of either table.
+    QSqlQuery attach(db);
+    attach.prepare("ATTACH DATABASE ? AS archive");
+    attach.addBindValue(archivePath(cohort));
+    if (!attach.exec()) {
+        qWarning() << "Failed to attach attempts archive:" << attach.lastError().text();
+        return;
+    }
+
+    // With WAL, a transaction that writes several files commits each on its
+    // own, main first: a crash can keep some and lose others. Anything that
+    // moves rows between files commits one file at a time (AttemptArchive).
+    QSqlQuery wal(db);
+    if (!wal.exec("PRAGMA archive.journal_mode = WAL")) {
+        qWarning() << "Failed to enable WAL on archive:" << wal.lastError().text();
+    }
+
+    // In a cohort shard, content and users come from the shared file. Attached
+    // after the archive: unqualified names resolve main first, then in order.
+    if (!cohort.isEmpty()) {
+        QSqlQuery shared(db);
+        shared.prepare("ATTACH DATABASE ? AS shared");
+        shared.addBindValue(dbPath());
+        if (!shared.exec()) {
+            qWarning() << "Failed to attach shared database:" << shared.lastError().text();
+            return;
+        }
+    }
+
+    QSqlQuery q(db);
+    // Clustered by user so one learner's history is a contiguous range;
+    // no secondary indexes, ids keep their hot-table values.
+    const bool ok = q.exec(R"(
+        CREATE TABLE IF NOT EXISTS archive.attempts(
+            user_id INTEGER NOT NULL,
+            id INTEGER NOT NULL,
+            question_id INTEGER NOT NULL,
+            timestamp INTEGER NOT NULL,
+            is_correct INTEGER NOT NULL,
+            answer INTEGER NOT NULL,
+            origin INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY(user_id, id)
+        ) WITHOUT ROWID
+    )") && createHistoryView(db);
+    if (!ok) qWarning() << "Failed to set up attempts archive:" << q.lastError().text();
+}
+
+bool Database::createHistoryView(QSqlDatabase db) {
+    QSqlQuery q(db);
+    if (!q.exec(R"(
+        CREATE TEMP VIEW IF NOT EXISTS attempts_all AS
+            SELECT id, user_id, question_id, timestamp, is_correct, answer, origin FROM main.attempts
+            UNION ALL
+            SELECT id, user_id, question_id, timestamp, is_correct, answer, origin FROM archive.attempts
+    )")) {
+        qWarning() << "Failed to create attempts_all:" << q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+qint64 Database::now() { return QDateTime::currentSecsSinceEpoch(); }
+
+qint64 Database::today() { return QDate::currentDate().toJulianDay(); }
+
 bool Database::init() {
     if (QSqlDatabase::contains("codeleveling"))
         s_db = QSqlDatabase::database("codeleveling");
     else
         s_db = QSqlDatabase::addDatabase("QSQLITE", "codeleveling");
 
+    {
+        QMutexLocker lock(&s_layoutLock);
+        s_cohort.clear();
+    }
     s_db.setDatabaseName(dbPath());
 
     if (!s_db.open()) {
@@ -32,31 +275,813 @@ bool Database::init() {
         return false;
     }
 
-    // IMPORTANT: do this after open()
-    {
-        QSqlQuery pragma(s_db);
-        if (!pragma.exec("PRAGMA foreign_keys = ON;")) {
-            qWarning() << "Failed to enable foreign keys:" << pragma.lastError().text();
-        }
-    }
+    s_nativeApi = checkNativeApi();
+    configure(s_db, QString());
 
-    if (!createTables()) return false;
+    // Fast path: schema, seed content and per-user progress rows are all
+    // current, so there is nothing to create, seed or backfill.
+    if (readStamp() == currentStamp()) return true;
+
+    if (!migrate()) return false;
     if (!seedIfEmpty()) return false;
     if (!seedDailyTasksIfEmpty()) return false;
 
     int uid = ensureDefaultUser();
     if (uid <= 0) return false;
 
-    if (!Database::initProgressForUser(uid)) return false;
+    // New content may have added quests: give every user their progress rows
+    {
+        QSqlQuery users(s_db);
+        if (!users.exec("SELECT id FROM users WHERE cohort IS NULL")) return false;
+        while (users.next()) {
+            if (!Database::initProgressForUser(s_db, users.value(0).toInt())) return false;
+        }
+    }
+
+    return writeStamp(kSchemaVersion, kContentVersion);
+}
+
+int Database::currentStamp() { return (kSchemaVersion << 16) | kContentVersion; }
+
+bool Database::nativeApi() { return s_nativeApi; }
+
+bool Database::checkNativeApi() {
+    // Two copies of SQLite in one process are fine as long as each only sees
+    // its own connections. Calling ours on the driver's sqlite3* is only
+    // sound when both are the same build.
+    QSqlQuery q(s_db);
+    if (!q.exec("SELECT sqlite_version(), sqlite_source_id()") || !q.next()) return false;
+    const QString version = q.value(0).toString();
+    const QString source = q.value(1).toString();
+
+    QStringList driverOptions, ourOptions;
+    if (q.exec("PRAGMA compile_options")) {
+        while (q.next()) driverOptions << q.value(0).toString();
+    }
+    for (int i = 0; const char* option = sqlite3_compileoption_get(i); ++i)
+        ourOptions << QString::fromLatin1(option);
+
+    if (version == QLatin1String(sqlite3_libversion()) && source == QLatin1String(sqlite3_sourceid())
+        && driverOptions == ourOptions)
+        return true;
+
+    qWarning() << "Qt's SQLite" << version << "is not the linked" << sqlite3_libversion()
+               << "- table hooks off, busy detection by error code";
+    return false;
+}
 
+sqlite3* Database::handle(QSqlDatabase db) {
+    if (!s_nativeApi) return nullptr;
+    const QVariant v = db.driver()->handle();
+    if (!v.isValid() || qstrcmp(v.typeName(), "sqlite3*") != 0) return nullptr;
+    return *static_cast<sqlite3* const*>(v.constData());
+}
+
+// ---- Concurrent writers ----
+
+Database::Contention Database::contention() {
+    Contention c;
+    c.transactions = s_contention.transactions;
+    c.retries = s_contention.retries;
+    c.failures = s_contention.failures;
+    c.waitMs = s_contention.waitMs;
+    c.maxWaitMs = s_contention.maxWaitMs;
+    return c;
+}
+
+qint64 Database::takePeakWaitMs() {
+    return s_contention.peakWaitMs.exchange(0);
+}
+
+bool Database::isBusy(QSqlDatabase db, const QSqlError& error) {
+    // The connection's last result; check before anything else runs on it.
+    // Without the handle, QSQLITE's native error code is the same number
+    // for the statement that reported the error.
+    sqlite3* h = handle(db);
+    const int rc = (h ? sqlite3_errcode(h) : error.nativeErrorCode().toInt()) & 0xff;
+    return rc == SQLITE_BUSY || rc == SQLITE_LOCKED;
+}
+
+bool Database::isInteractive(QSqlDatabase db) {
+    return s_interactive && db.connectionName() == s_db.connectionName();
+}
+
+int Database::busyTimeoutMs(QSqlDatabase db) {
+    return isInteractive(db) ? kInteractiveBusyMs : kBusyTimeoutMs;
+}
 
+void Database::setInteractive(bool on) {
+    s_interactive = on;
+    QSqlQuery q(s_db);
+    if (!q.exec(QStringLiteral("PRAGMA busy_timeout = %1").arg(busyTimeoutMs(s_db))))
+        qWarning() << "Failed to set busy timeout:" << q.lastError().text();
+}
+
+bool Database::lastWriteBusy() { return t_lastBusy; }
+
+bool Database::begin(QSqlDatabase db) {
+    return beginBy(db, QDeadlineTimer(isInteractive(db) ? 0 : kWriteDeadlineMs));
+}
+
+bool Database::beginBy(QSqlDatabase db, const QDeadlineTimer& deadline) {
+    QElapsedTimer timer;
+    timer.start();
+    t_lastBusy = false;
+
+    QSqlQuery q(db);
+    for (int attempt = 0;; ++attempt) {
+        if (q.exec("BEGIN IMMEDIATE")) {
+            ++s_contention.transactions;
+            recordWait(timer.elapsed());
+            return true;
+        }
+        t_lastBusy = isBusy(db, q.lastError());
+        if (!t_lastBusy || !backoff(attempt, deadline)) break;
+        ++s_contention.retries;
+    }
+
+    ++s_contention.failures;
+    recordWait(timer.elapsed());
+    qWarning() << "begin failed after" << timer.elapsed() << "ms:" << q.lastError().text();
+    return false;
+}
+
+bool Database::write(QSqlDatabase db, const std::function<bool()>& work, const char* what) {
+    // One deadline for the whole unit: retries of the unit and of its
+    // BEGIN share it instead of multiplying.
+    const QDeadlineTimer deadline(isInteractive(db) ? 0 : kWriteDeadlineMs);
+    for (int attempt = 0;; ++attempt) {
+        if (!beginBy(db, deadline)) return false;
+        if (work() && db.commit()) return true;
+
+        const bool busy = isBusy(db, db.lastError());
+        const QString error = db.lastError().text();
+        db.rollback();
+        t_lastBusy = busy;
+        if (!busy || !backoff(attempt, deadline)) {
+            ++s_contention.failures;
+            qWarning() << what << "failed:" << error;
+            return false;
+        }
+        ++s_contention.retries;
+    }
+}
+
+int Database::readStamp() {
+    QSqlQuery q(s_db);
+    if (!q.exec("PRAGMA user_version") || !q.next()) return -1;
+    return q.value(0).toInt();
+}
+
+bool Database::writeStamp(int schema, int content) {
+    QSqlQuery q(s_db);
+    if (!q.exec(QString("PRAGMA user_version = %1").arg((schema << 16) | content))) {
+        qWarning() << "Failed to write version stamp:" << q.lastError().text();
+        return false;
+    }
     return true;
 }
 
 
+namespace {
+
+// Current schema. "%1" is the table name so migrations can build the new
+// table next to the old one before swapping them.
+struct TableDef { const char* name; const char* ddl; };
+
+const TableDef kTables[] = {
+    {"users", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            username TEXT NOT NULL UNIQUE,
+            created_at INTEGER NOT NULL DEFAULT (CAST(strftime('%s','now') AS INTEGER)),
+            cohort TEXT                              -- shard name; NULL = this file
+        )
+    )"},
+    {"user_stats", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER PRIMARY KEY,
+            total_xp INTEGER NOT NULL DEFAULT 0,
+            level INTEGER NOT NULL DEFAULT 1,
+            last_active INTEGER,                     -- epoch seconds
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )"},
+    {"leaderboard_agg", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER PRIMARY KEY,             -- user_stats of every cohort
+            total_xp INTEGER NOT NULL DEFAULT 0,
+            level INTEGER NOT NULL DEFAULT 1,
+            last_active INTEGER,
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )"},
+    {"quests", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            title TEXT NOT NULL,
+            topic TEXT NOT NULL,
+            difficulty INTEGER NOT NULL DEFAULT 1
+        )
+    )"},
+    {"quest_progress", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER NOT NULL,
+            quest_id INTEGER NOT NULL,
+            status INTEGER NOT NULL DEFAULT 0,       -- Database::QuestStatus
+            best_score INTEGER NOT NULL DEFAULT 0,
+            last_attempt INTEGER,                    -- epoch seconds
+            PRIMARY KEY(user_id, quest_id),
+            FOREIGN KEY(user_id) REFERENCES users(id),
+            FOREIGN KEY(quest_id) REFERENCES quests(id)
+        ) WITHOUT ROWID
+    )"},
+    {"lessons", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            quest_id INTEGER PRIMARY KEY,
+            body TEXT NOT NULL,
+            FOREIGN KEY(quest_id) REFERENCES quests(id)
+        )
+    )"},
+    {"questions", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            quest_id INTEGER NOT NULL,
+            type TEXT NOT NULL,              -- mcq (for now)
+            prompt TEXT NOT NULL,
+            choices_json TEXT NOT NULL,
+            answer_json TEXT NOT NULL,
+            xp_value INTEGER NOT NULL DEFAULT 10,
+            FOREIGN KEY(quest_id) REFERENCES quests(id)
+        )
+    )"},
+    {"attempts", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            user_id INTEGER NOT NULL,
+            question_id INTEGER NOT NULL,
+            timestamp INTEGER NOT NULL DEFAULT (CAST(strftime('%s','now') AS INTEGER)),
+            is_correct INTEGER NOT NULL,
+            answer INTEGER NOT NULL,                 -- mcq: selected choice index
+            origin INTEGER NOT NULL DEFAULT 0,       -- 0 = recorded here, else sync_peers.id
+            FOREIGN KEY(user_id) REFERENCES users(id),
+            FOREIGN KEY(question_id) REFERENCES questions(id)
+        )
+    )"},
+    {"attempt_summary", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER NOT NULL,
+            question_id INTEGER NOT NULL,
+            attempts INTEGER NOT NULL DEFAULT 0,     -- hot + archived
+            correct INTEGER NOT NULL DEFAULT 0,
+            first_ts INTEGER NOT NULL,               -- epoch seconds
+            last_ts INTEGER NOT NULL,
+            PRIMARY KEY(user_id, question_id),
+            FOREIGN KEY(user_id) REFERENCES users(id),
+            FOREIGN KEY(question_id) REFERENCES questions(id)
+        ) WITHOUT ROWID
+    )"},
+    {"question_stats", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            question_id INTEGER PRIMARY KEY,
+            attempts INTEGER NOT NULL DEFAULT 0,
+            correct INTEGER NOT NULL DEFAULT 0,
+            learners INTEGER NOT NULL DEFAULT 0,          -- users with any attempt
+            first_try_correct INTEGER NOT NULL DEFAULT 0, -- learners right on their first attempt
+            mastered INTEGER NOT NULL DEFAULT 0,          -- learners with a correct attempt
+            attempts_to_mastery INTEGER NOT NULL DEFAULT 0, -- sum over mastered learners
+            FOREIGN KEY(question_id) REFERENCES questions(id)
+        )
+    )"},
+    {"question_picks", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            question_id INTEGER NOT NULL,
+            choice INTEGER NOT NULL,
+            picks INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY(question_id, choice),
+            FOREIGN KEY(question_id) REFERENCES questions(id)
+        ) WITHOUT ROWID
+    )"},
+    {"question_timing", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            question_id INTEGER PRIMARY KEY,
+            think BLOB,                              -- TimeHistogram: shown -> submitted
+            latency BLOB,                            -- TimeHistogram: submitted -> feedback frame
+            FOREIGN KEY(question_id) REFERENCES questions(id)
+        )
+    )"},
+    {"user_timing", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER PRIMARY KEY,
+            think BLOB,
+            latency BLOB,
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )"},
+    {"quest_funnel", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            quest_id INTEGER PRIMARY KEY,
+            started INTEGER NOT NULL DEFAULT 0,      -- learners with any attempt in the quest
+            completed INTEGER NOT NULL DEFAULT 0,
+            FOREIGN KEY(quest_id) REFERENCES quests(id)
+        )
+    )"},
+    {"daily_tasks", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            title TEXT NOT NULL,
+            xp_value INTEGER NOT NULL DEFAULT 10,
+            active INTEGER NOT NULL DEFAULT 1,
+            action INTEGER NOT NULL DEFAULT 0,       -- DailyTracker::Action
+            target INTEGER NOT NULL DEFAULT 1
+        )
+    )"},
+    {"daily_completions", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,    -- sync export order
+            user_id INTEGER NOT NULL,
+            task_id INTEGER NOT NULL,
+            day INTEGER NOT NULL,                    -- local Julian day
+            completed_at INTEGER NOT NULL DEFAULT (CAST(strftime('%s','now') AS INTEGER)),
+            origin INTEGER NOT NULL DEFAULT 0,       -- 0 = recorded here, else sync_peers.id
+            UNIQUE(user_id, task_id, day),
+            FOREIGN KEY(user_id) REFERENCES users(id),
+            FOREIGN KEY(task_id) REFERENCES daily_tasks(id)
+        )
+    )"},
+    {"daily_progress", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER NOT NULL,
+            task_id INTEGER NOT NULL,
+            day INTEGER NOT NULL,                    -- local Julian day
+            count INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY(user_id, task_id, day),
+            FOREIGN KEY(user_id) REFERENCES users(id),
+            FOREIGN KEY(task_id) REFERENCES daily_tasks(id)
+        ) WITHOUT ROWID
+    )"},
+    {"achievement_state", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER PRIMARY KEY,
+            unlocked INTEGER NOT NULL DEFAULT 0,      -- bit per achievement
+            correct_run INTEGER NOT NULL DEFAULT 0,
+            day_streak INTEGER NOT NULL DEFAULT 0,
+            last_day INTEGER NOT NULL DEFAULT 0,      -- Julian day
+            quests_done BLOB,                         -- bit per quest id
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )"},
+    {"xp_ledger", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            user_id INTEGER NOT NULL,
+            source INTEGER NOT NULL,                 -- XpLedger::Source
+            amount INTEGER NOT NULL,
+            created_at INTEGER NOT NULL DEFAULT (CAST(strftime('%s','now') AS INTEGER)),
+            origin INTEGER NOT NULL DEFAULT 0,       -- 0 = recorded here, else sync_peers.id
+            ref INTEGER,                             -- quest or daily task id of Quest/Daily rows
+            day INTEGER,                             -- local Julian day it was earned
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )"},
+    {"xp_snapshots", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER PRIMARY KEY,
+            ledger_id INTEGER NOT NULL,
+            total_xp INTEGER NOT NULL,
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )"},
+    {"sync_state", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            key TEXT PRIMARY KEY,                    -- machine_id, next_seq
+            value
+        ) WITHOUT ROWID
+    )"},
+    {"sync_peers", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            machine TEXT NOT NULL UNIQUE
+        )
+    )"},
+    {"sync_imports", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            peer_id INTEGER NOT NULL,
+            seq INTEGER NOT NULL,
+            imported_at INTEGER NOT NULL,            -- epoch seconds
+            PRIMARY KEY(peer_id, seq),
+            FOREIGN KEY(peer_id) REFERENCES sync_peers(id)
+        ) WITHOUT ROWID
+    )"},
+    {"sync_watermarks", R"(
+        CREATE TABLE IF NOT EXISTS %1(
+            user_id INTEGER PRIMARY KEY,
+            attempt_id INTEGER NOT NULL DEFAULT 0,   -- last exported local attempts.id
+            ledger_id INTEGER NOT NULL DEFAULT 0,    -- last exported local xp_ledger.id
+            completion_id INTEGER NOT NULL DEFAULT 0, -- last exported local daily_completions.id
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )"},
+};
+
+// Covering indexes for the hot queries in AppController / DailyTracker / XpLedger.
+const char* const kIndexes[] = {
+    // quest mastery check and question lookup per quest
+    "CREATE INDEX IF NOT EXISTS idx_questions_quest ON questions(quest_id, id)",
+    // XpLedger::total: tail after the snapshot
+    "CREATE INDEX IF NOT EXISTS idx_ledger_user ON xp_ledger(user_id, id, amount)",
+    // loadUsers
+    "CREATE INDEX IF NOT EXISTS idx_users_name ON users(username COLLATE NOCASE)",
+};
+
+// Per-learner tables: what a cohort shard holds. Foreign keys cannot
+// reach into the shared file, so shards are created without them.
+const char* const kShardTables[] = {
+    "user_stats", "quest_progress", "attempts", "attempt_summary", "daily_completions",
+    "daily_progress", "achievement_state", "xp_ledger", "xp_snapshots", "sync_watermarks",
+    "user_timing", "sync_imports",
+};
+
+const TableDef* findTable(const char* name) {
+    for (const auto &t : kTables)
+        if (qstrcmp(t.name, name) == 0) return &t;
+    return nullptr;
+}
+
+// A per-learner table as a shard holds it: foreign keys cannot reach into
+// the shared file.
+QString shardDdl(const TableDef* def, const QString& target) {
+    static const QRegularExpression foreignKey(
+        QStringLiteral(R"(,(\s*--[^\n]*)?\s*FOREIGN KEY\s*\([^)]*\)\s*REFERENCES\s+\w+\s*\([^)]*\))"));
+    QString ddl = QString::fromLatin1(def->ddl).arg(target);
+    return ddl.replace(foreignKey, QStringLiteral("\\1"));
+}
+
+// v9: daily completions get ids in the order they were recorded, and
+// export watermarks move from completed_at to those ids. Rows recorded in
+// the watermark's own second may not have been exported yet; they are sent
+// again, and merging ignores what a peer already has.
+const char kCompletionColumns[] = "user_id, task_id, day, completed_at";
+const char kCompletionSelect[] =
+    "SELECT user_id, task_id, day, completed_at FROM daily_completions ORDER BY completed_at, user_id, task_id";
+const char kWatermarkColumns[] = "user_id, attempt_id, ledger_id, completion_id";
+const char kWatermarkSelect[] = R"(
+    SELECT w.user_id, w.attempt_id, w.ledger_id,
+           COALESCE((SELECT MAX(c.id) FROM daily_completions c
+                     WHERE c.user_id = w.user_id AND c.completed_at < w.completed_at), 0)
+    FROM sync_watermarks w
+)";
+
+} // namespace
+
 bool Database::createTables() {
     QSqlQuery q(s_db);
 
+    for (const auto &t : kTables) {
+        if (!q.exec(QString::fromLatin1(t.ddl).arg(QLatin1String(t.name)))) {
+            qWarning() << t.name << q.lastError().text();
+            return false;
+        }
+    }
+    for (const char* idx : kIndexes) {
+        if (!q.exec(QString::fromLatin1(idx))) { qWarning() << q.lastError().text(); return false; }
+    }
+    return true;
+}
+
+// ---- Cohort shards ----
+
+QString Database::currentCohort() {
+    QMutexLocker lock(&s_layoutLock);
+    return s_cohort;
+}
+
+QString Database::cohortOf(QSqlDatabase db, int userId) {
+    QSqlQuery q(db);
+    q.prepare("SELECT cohort FROM users WHERE id = ?");
+    q.addBindValue(userId);
+    if (!q.exec() || !q.next()) return QString();
+    return q.value(0).toString();
+}
+
+bool Database::isValidCohort(const QString& name) {
+    // Becomes part of a file name.
+    static const QRegularExpression re(QStringLiteral("^[A-Za-z0-9_-]{1,64}$"));
+    return re.match(name).hasMatch();
+}
+
+bool Database::useCohort(const QString& cohort) {
+    const QString previous = currentCohort();
+    if (cohort == previous) return true;
+    if (!cohort.isEmpty() && !isValidCohort(cohort)) {
+        qWarning() << "Invalid cohort name:" << cohort;
+        return false;
+    }
+
+    if (openCohort(cohort)) {
+        qInfo() << "Opened cohort" << (cohort.isEmpty() ? QStringLiteral("(shared)") : cohort);
+        return true;
+    }
+    openCohort(previous);
+    return false;
+}
+
+bool Database::openCohort(const QString& cohort) {
+    s_db.close();
+    {
+        QMutexLocker lock(&s_layoutLock);
+        s_cohort = cohort;
+    }
+    ++s_generation;
+
+    s_db.setDatabaseName(mainPath());
+    if (!s_db.open()) {
+        qWarning() << "DB open failed:" << s_db.lastError().text();
+        return false;
+    }
+    configure(s_db, cohort);
+    return cohort.isEmpty() || prepareShard();
+}
+
+bool Database::prepareShard() {
+    const int stamp = readStamp();
+    if (stamp == currentStamp()) return true;
+    if (stamp > currentStamp()) {
+        qWarning() << "Cohort shard is from a newer version:" << stamp;
+        return false;
+    }
+
+    // New shard, or one from before a content or schema bump. Tables are
+    // created as needed; a migration that changes a per-learner table's
+    // columns must repeat that step here.
+    if (!begin(s_db)) return false;
+    QSqlQuery q(s_db);
+    bool ok = true;
+    for (const char* name : kShardTables) {
+        ok = q.exec(shardDdl(findTable(name), QLatin1String("main.") + QLatin1String(name)));
+        if (!ok) break;
+    }
+
+    // Per-shard steps of schema migrations, for shards made before them.
+    const int schema = stamp >> 16;
+    if (ok && stamp > 0 && schema < 8) {
+        // Import marks used to live in the shared file, for every cohort.
+        ok = q.exec("INSERT OR IGNORE INTO main.sync_imports SELECT * FROM shared.sync_imports");
+    }
+    if (ok && stamp > 0 && schema < 9) {
+        ok = (hasColumn("main.daily_completions", "origin")
+              || rebuildTable("daily_completions", kCompletionColumns, kCompletionSelect, true))
+             && (!hasColumn("main.sync_watermarks", "completed_at")
+                 || rebuildTable("sync_watermarks", kWatermarkColumns, kWatermarkSelect, true))
+             && addColumnIfMissing("main.xp_ledger", "ref", "INTEGER")
+             && addColumnIfMissing("main.xp_ledger", "day", "INTEGER");
+    }
+
+    for (const char* idx : kIndexes) {
+        if (!ok) break;
+        const QString sql = QString::fromLatin1(idx);
+        for (const char* name : kShardTables) {
+            if (sql.contains(QStringLiteral(" ON %1(").arg(QLatin1String(name)))) ok = q.exec(sql);
+        }
+    }
+    if (!ok) qWarning() << "Cohort shard setup failed:" << q.lastError().text();
+
+    // New content may have added quests: give the cohort's users their progress rows
+    QSqlQuery users(s_db);
+    users.prepare("SELECT id FROM users WHERE cohort = ?");
+    users.addBindValue(currentCohort());
+    ok = ok && users.exec();
+    while (ok && users.next()) ok = initProgressForUser(s_db, users.value(0).toInt());
+
+    if (!ok || !writeStamp(kSchemaVersion, kContentVersion) || !s_db.commit()) {
+        s_db.rollback();
+        return false;
+    }
+    return true;
+}
+
+bool Database::publishStats(QSqlDatabase db, int userId) {
+    QSqlQuery q(db);
+    q.prepare(R"(
+        INSERT INTO leaderboard_agg(user_id, total_xp, level, last_active)
+        SELECT user_id, total_xp, level, last_active FROM user_stats WHERE user_id = ?
+        ON CONFLICT(user_id) DO UPDATE SET
+            total_xp = excluded.total_xp,
+            level = excluded.level,
+            last_active = excluded.last_active
+    )");
+    q.addBindValue(userId);
+    if (!q.exec()) {
+        qWarning() << "leaderboard publish failed:" << q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+int Database::schemaVersion() {
+    // user_version holds (schema << 16) | content; files stamped before the
+    // content half existed hold the bare schema number.
+    const int stamp = readStamp();
+    return stamp >= 0x10000 ? stamp >> 16 : stamp;
+}
+
+bool Database::tableExists(const QString& table) {
+    QSqlQuery q(s_db);
+    q.prepare("SELECT 1 FROM sqlite_master WHERE type='table' AND name=?");
+    q.addBindValue(table);
+    return q.exec() && q.next();
+}
+
+qint64 Database::sizeOnDisk() {
+    QSqlQuery q(s_db);
+    if (!q.exec("SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size()") || !q.next())
+        return -1;
+    return q.value(0).toLongLong();
+}
+
+bool Database::migrate() {
+    struct Migration { int version; const char* name; bool (*apply)(); };
+    static const Migration migrations[] = {
+        {2, "integer enums/dates, compact answers, covering indexes", &Database::migrateToV2},
+        {3, "per-question attempt summary, attempts archive", &Database::migrateToV3},
+        {4, "row origins and bookkeeping for file sync", &Database::migrateToV4},
+        {5, "incremental question and quest analytics", &Database::migrateToV5},
+        {6, "cohort shards, cross-cohort leaderboard", &Database::migrateToV6},
+        {7, "response time histograms", &Database::migrateToV7},
+        {8, "sync import marks kept with the cohort's rows", &Database::migrateToV8},
+        {9, "daily completion ids and origins, XP ledger references for sync", &Database::migrateToV9},
+    };
+
+    const int from = schemaVersion();
+    if (from < 0) return false;
+    if (from >= kSchemaVersion) return true;
+
+    if (!tableExists("users")) {
+        // Fresh file: create the current schema directly
+        if (!createTables()) return false;
+        return writeStamp(kSchemaVersion, 0);
+    }
+
+    const qint64 sizeBefore = sizeOnDisk();
+
+    // Table rebuilds need FK enforcement off; it cannot change inside a transaction.
+    QSqlQuery fk(s_db);
+    fk.exec("PRAGMA foreign_keys = OFF");
+    // RENAME re-checks every view, and attempts_all only fits the current schema.
+    fk.exec("DROP VIEW IF EXISTS temp.attempts_all");
+
+    bool ok = true;
+    for (const auto &m : migrations) {
+        if (m.version <= from) continue;
+        qInfo() << "Migrating database to schema" << m.version << "-" << m.name;
+
+        if (!begin(s_db)) { ok = false; break; }
+
+        QSqlQuery q(s_db);
+        ok = m.apply()
+             && q.exec("PRAGMA foreign_key_check") && !q.next()
+             && writeStamp(m.version, 0);
+        if (!ok || !s_db.commit()) {
+            qWarning() << "Migration to schema" << m.version << "failed:" << q.lastError().text();
+            s_db.rollback();
+            ok = false;
+            break;
+        }
+    }
+
+    fk.exec("PRAGMA foreign_keys = ON");
+    if (!ok) return false;
+    createHistoryView(s_db);
+
+    QSqlQuery vacuum(s_db);
+    if (!vacuum.exec("VACUUM")) qWarning() << "VACUUM failed:" << vacuum.lastError().text();
+    qInfo() << "Database size before/after migration:" << sizeBefore << "->" << sizeOnDisk() << "bytes";
+    return true;
+}
+
+bool Database::rebuildTable(const char* table, const QString& columns, const QString& select, bool shard) {
+    const TableDef* def = findTable(table);
+    if (!def) return false;
+
+    const QString name = QLatin1String(table);
+    const QString tmp = name + "_v2";
+
+    QSqlQuery q(s_db);
+    const bool ok = q.exec(shard ? shardDdl(def, "main." + tmp) : QString::fromLatin1(def->ddl).arg(tmp))
+                    && q.exec(QString("INSERT INTO %1(%2) %3").arg(tmp, columns, select))
+                    && q.exec(QString("DROP TABLE %1").arg(name))
+                    && q.exec(QString("ALTER TABLE %1 RENAME TO %2").arg(tmp, name));
+    if (!ok) qWarning() << "rebuild" << table << "failed:" << q.lastError().text();
+    return ok;
+}
+
+bool Database::migrateToV2() {
+    if (!createLegacyTables()) return false;
+
+    // Legacy TEXT timestamps -> epoch seconds, TEXT days -> Julian day
+    const QString epoch = "COALESCE(CAST(strftime('%s', %1) AS INTEGER), 0)";
+    const QString epochOrNull = "CAST(strftime('%s', %1) AS INTEGER)";
+    const QString julianDay = "CAST(julianday(%1) + 0.5 AS INTEGER)";
+    // Legacy days came from date('now'), a UTC date; day columns now hold
+    // the local date. A completion's is that of its UTC completed_at. Only
+    // today's counters still matter, so those move from UTC today to
+    // local today; merged rows keep the larger count.
+    const QString localDay = "COALESCE(date(completed_at, 'localtime'), day)";
+
+    return rebuildTable("users", "id, username, created_at",
+                        QString("SELECT id, username, %1 FROM users").arg(epoch.arg("created_at")))
+        && rebuildTable("user_stats", "user_id, total_xp, level, last_active",
+                        QString("SELECT user_id, total_xp, level, %1 FROM user_stats").arg(epochOrNull.arg("last_active")))
+        && rebuildTable("quest_progress", "user_id, quest_id, status, best_score, last_attempt",
+                        QString(R"(SELECT user_id, quest_id,
+                                          CASE status WHEN 'completed' THEN 2 WHEN 'unlocked' THEN 1 ELSE 0 END,
+                                          best_score, %1
+                                   FROM quest_progress)").arg(epochOrNull.arg("last_attempt")))
+        && rebuildTable("attempts", "id, user_id, question_id, timestamp, is_correct, answer",
+                        QString(R"(SELECT id, user_id, question_id, %1, is_correct,
+                                          COALESCE(json_extract(user_answer_json, '$.selectedIndex'), -1)
+                                   FROM attempts)").arg(epoch.arg("timestamp")))
+        && rebuildTable("daily_completions", "user_id, task_id, day, completed_at",
+                        QString(R"(SELECT user_id, task_id, %1 AS local_day, MIN(%2)
+                                   FROM daily_completions
+                                   GROUP BY user_id, task_id, local_day
+                                   ORDER BY MIN(%2))")
+                            .arg(julianDay.arg(localDay), epoch.arg("completed_at")))
+        && rebuildTable("daily_progress", "user_id, task_id, day, count",
+                        QString(R"(SELECT user_id, task_id, %1 AS local_day, MAX(count)
+                                   FROM daily_progress
+                                   GROUP BY user_id, task_id, local_day)")
+                            .arg(julianDay.arg("CASE WHEN day = date('now') THEN date('now', 'localtime') ELSE day END")))
+        && rebuildTable("xp_ledger", "id, user_id, source, amount, created_at",
+                        QString("SELECT id, user_id, source, amount, %1 FROM xp_ledger").arg(epoch.arg("created_at")))
+        && createTables();
+}
+
+bool Database::migrateToV3() {
+    // Hot queries read attempt_summary now; attempts only needs its rowid.
+    // Nothing has been archived before v3, so the hot table is the whole history.
+    QSqlQuery q(s_db);
+    const bool ok = createTables()
+                    && q.exec("DROP INDEX IF EXISTS idx_attempts_user_qid")
+                    && q.exec(R"(
+                        INSERT OR REPLACE INTO attempt_summary(user_id, question_id, attempts, correct, first_ts, last_ts)
+                        SELECT user_id, question_id, COUNT(*), SUM(is_correct), MIN(timestamp), MAX(timestamp)
+                        FROM attempts
+                        GROUP BY user_id, question_id
+                    )");
+    if (!ok) qWarning() << "attempt summary backfill failed:" << q.lastError().text();
+    return ok;
+}
+
+bool Database::migrateToV4() {
+    const QString origin = "INTEGER NOT NULL DEFAULT 0";
+    return addColumnIfMissing("attempts", "origin", origin)
+        && addColumnIfMissing("archive.attempts", "origin", origin)
+        && addColumnIfMissing("xp_ledger", "origin", origin)
+        && createTables();
+}
+
+bool Database::migrateToV5() {
+    // migrate() dropped attempts_all for the table rebuilds; the backfill needs it.
+    return createTables() && createHistoryView(s_db) && Analytics::rebuild(s_db);
+}
+
+bool Database::migrateToV6() {
+    QSqlQuery q(s_db);
+    return addColumnIfMissing("users", "cohort", "TEXT")
+        && createTables()
+        && q.exec(R"(
+            INSERT OR REPLACE INTO leaderboard_agg(user_id, total_xp, level, last_active)
+            SELECT user_id, total_xp, level, last_active FROM user_stats
+        )");
+}
+
+bool Database::migrateToV7() {
+    return createTables();
+}
+
+bool Database::migrateToV8() {
+    // Nothing changes in the shared file; shards copy its sync_imports.
+    return createTables();
+}
+
+bool Database::migrateToV9() {
+    // Files that passed through v2 or v4 already have the new shapes.
+    return (hasColumn("daily_completions", "origin")
+            || rebuildTable("daily_completions", kCompletionColumns, kCompletionSelect))
+        && (!hasColumn("sync_watermarks", "completed_at")
+            || rebuildTable("sync_watermarks", kWatermarkColumns, kWatermarkSelect))
+        && addColumnIfMissing("xp_ledger", "ref", "INTEGER")
+        && addColumnIfMissing("xp_ledger", "day", "INTEGER")
+        && createTables();
+}
+
+// Schema v1 as shipped before migrations existed, plus the tables added on
+// top of it before v2. Only used to bring an old file to a known v1 shape
+// right before migrating it; fresh databases get createTables() instead.
+bool Database::createLegacyTables() {
+    QSqlQuery q(s_db);
+
     // ---- Users ----
     if (!q.exec(R"(
         CREATE TABLE IF NOT EXISTS users(
@@ -149,10 +1174,16 @@ bool Database::createTables() {
             id INTEGER PRIMARY KEY AUTOINCREMENT,
             title TEXT NOT NULL,
             xp_value INTEGER NOT NULL DEFAULT 10,
-            active INTEGER NOT NULL DEFAULT 1
+            active INTEGER NOT NULL DEFAULT 1,
+            action INTEGER NOT NULL DEFAULT 0,   -- DailyTracker::Action
+            target INTEGER NOT NULL DEFAULT 1
         )
     )")) { qWarning() << q.lastError().text(); return false; }
 
+    // Older DBs predate rule-driven dailies
+    if (!addColumnIfMissing("daily_tasks", "action", "INTEGER NOT NULL DEFAULT 0")) return false;
+    if (!addColumnIfMissing("daily_tasks", "target", "INTEGER NOT NULL DEFAULT 1")) return false;
+
     // ---- Daily completions (per user, per day) ----
     if (!q.exec(R"(
         CREATE TABLE IF NOT EXISTS daily_completions(
@@ -169,6 +1200,97 @@ bool Database::createTables() {
     q.exec("CREATE INDEX IF NOT EXISTS idx_daily_day ON daily_completions(day)");
     q.exec("CREATE INDEX IF NOT EXISTS idx_daily_user ON daily_completions(user_id)");
 
+    // ---- Daily progress counters (per user, per task, per day) ----
+    if (!q.exec(R"(
+        CREATE TABLE IF NOT EXISTS daily_progress(
+            user_id INTEGER NOT NULL,
+            task_id INTEGER NOT NULL,
+            day TEXT NOT NULL,
+            count INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY(user_id, task_id, day),
+            FOREIGN KEY(user_id) REFERENCES users(id),
+            FOREIGN KEY(task_id) REFERENCES daily_tasks(id)
+        ) WITHOUT ROWID
+    )")) { qWarning() << q.lastError().text(); return false; }
+
+    // ---- Achievement rule state (per user) ----
+    if (!q.exec(R"(
+        CREATE TABLE IF NOT EXISTS achievement_state(
+            user_id INTEGER PRIMARY KEY,
+            unlocked INTEGER NOT NULL DEFAULT 0,      -- bit per achievement
+            correct_run INTEGER NOT NULL DEFAULT 0,
+            day_streak INTEGER NOT NULL DEFAULT 0,
+            last_day INTEGER NOT NULL DEFAULT 0,      -- Julian day
+            quests_done BLOB,                         -- bit per quest id
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )")) { qWarning() << q.lastError().text(); return false; }
+
+    // ---- XP ledger (append-only, per user) ----
+    if (!q.exec(R"(
+        CREATE TABLE IF NOT EXISTS xp_ledger(
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            user_id INTEGER NOT NULL,
+            source INTEGER NOT NULL,                 -- XpLedger::Source
+            amount INTEGER NOT NULL,
+            created_at TEXT NOT NULL DEFAULT (datetime('now')),
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )")) { qWarning() << q.lastError().text(); return false; }
+
+    if (!q.exec("CREATE INDEX IF NOT EXISTS idx_ledger_user ON xp_ledger(user_id, id, amount)")) {
+        qWarning() << q.lastError().text();
+        return false;
+    }
+
+    // ---- XP snapshots: total of all ledger rows up to ledger_id ----
+    if (!q.exec(R"(
+        CREATE TABLE IF NOT EXISTS xp_snapshots(
+            user_id INTEGER PRIMARY KEY,
+            ledger_id INTEGER NOT NULL,
+            total_xp INTEGER NOT NULL,
+            FOREIGN KEY(user_id) REFERENCES users(id)
+        )
+    )")) { qWarning() << q.lastError().text(); return false; }
+
+    // Carry totals from before the ledger over as one opening entry
+    if (!q.exec(R"(
+        INSERT INTO xp_ledger(user_id, source, amount)
+        SELECT s.user_id, 0, s.total_xp
+        FROM user_stats s
+        WHERE s.total_xp > 0
+          AND NOT EXISTS(SELECT 1 FROM xp_ledger l WHERE l.user_id = s.user_id)
+    )")) { qWarning() << q.lastError().text(); return false; }
+
+    return true;
+}
+
+bool Database::hasColumn(const QString& table, const QString& column) {
+    // "schema.table" names an attached database's table
+    const int dot = table.indexOf('.');
+    const QString pragma = dot < 0
+        ? QString("PRAGMA table_info(%1)").arg(table)
+        : QString("PRAGMA %1.table_info(%2)").arg(table.left(dot), table.mid(dot + 1));
+
+    QSqlQuery q(s_db);
+    if (!q.exec(pragma)) {
+        qWarning() << q.lastError().text();
+        return false;
+    }
+    while (q.next()) {
+        if (q.value(1).toString() == column) return true;
+    }
+    return false;
+}
+
+bool Database::addColumnIfMissing(const QString& table, const QString& column, const QString& decl) {
+    if (hasColumn(table, column)) return true;
+
+    QSqlQuery alter(s_db);
+    if (!alter.exec(QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table, column, decl))) {
+        qWarning() << alter.lastError().text();
+        return false;
+    }
     return true;
 }
 
@@ -375,54 +1497,77 @@ bool Database::seedLessonsIfEmpty() {
 
 int Database::ensureDefaultUser() {
     QSqlQuery ins(s_db);
-    ins.exec("INSERT OR IGNORE INTO users(username) VALUES('LocalUser')");
+    if (!ins.exec("INSERT OR IGNORE INTO users(username) VALUES('LocalUser')")) {
+        qWarning() << "default user failed:" << ins.lastError().text();
+        return -1;
+    }
 
     QSqlQuery q(s_db);
-    q.exec("SELECT id FROM users WHERE username='LocalUser' LIMIT 1");
-    if (!q.next()) return -1;
+    if (!q.exec("SELECT id FROM users WHERE username='LocalUser' LIMIT 1") || !q.next()) return -1;
     int uid = q.value(0).toInt();
 
     QSqlQuery st(s_db);
-    st.prepare("INSERT OR IGNORE INTO user_stats(user_id,total_xp,level,last_active) VALUES(?,0,1,datetime('now'))");
+    st.prepare("INSERT OR IGNORE INTO user_stats(user_id,total_xp,level,last_active) VALUES(?,0,1,?)");
     st.addBindValue(uid);
-    st.exec();
+    st.addBindValue(now());
+    if (!st.exec()) {
+        qWarning() << "default user stats failed:" << st.lastError().text();
+        return -1;
+    }
+    if (!publishStats(s_db, uid)) return -1;
 
     return uid;
 }
 bool Database::seedDailyTasksIfEmpty() {
+    // title, xp, action (DailyTracker::Action), target
+    struct Seed { const char* title; int xp; int action; int target; };
+    const Seed seeds[] = {
+        {"Answer 1 quiz question", 15, 1, 1},
+        {"Complete 1 quest attempt", 20, 2, 1},
+        {"Review a lesson", 10, 3, 1},
+    };
+
     QSqlQuery q(s_db);
     if (!q.exec("SELECT COUNT(*) FROM daily_tasks")) return false;
     q.next();
-    if (q.value(0).toInt() > 0) return true;
+    if (q.value(0).toInt() > 0) {
+        // Tasks seeded before dailies were rule-driven: attach their rules
+        QSqlQuery up(s_db);
+        up.prepare("UPDATE daily_tasks SET action=?, target=? WHERE title=? AND action=0");
+        for (const auto &s : seeds) {
+            up.addBindValue(s.action);
+            up.addBindValue(s.target);
+            up.addBindValue(QString::fromUtf8(s.title));
+            if (!up.exec()) { qWarning() << up.lastError().text(); return false; }
+        }
+        return true;
+    }
 
     QSqlQuery ins(s_db);
-    ins.prepare("INSERT INTO daily_tasks(title, xp_value, active) VALUES(?, ?, 1)");
+    ins.prepare("INSERT INTO daily_tasks(title, xp_value, active, action, target) VALUES(?, ?, 1, ?, ?)");
 
-    auto add = [&](const QString& title, int xp){
-        ins.addBindValue(title);
-        ins.addBindValue(xp);
-        return ins.exec();
-    };
-
-    if (!add("Answer 1 quiz question", 15)) return false;
-    if (!add("Complete 1 quest attempt", 20)) return false;
-    if (!add("Review a lesson", 10)) return false;
+    for (const auto &s : seeds) {
+        ins.addBindValue(QString::fromUtf8(s.title));
+        ins.addBindValue(s.xp);
+        ins.addBindValue(s.action);
+        ins.addBindValue(s.target);
+        if (!ins.exec()) return false;
+    }
 
     return true;
 }
 
-bool Database::initProgressForUser(int userId) {
-    QSqlDatabase db = Database::db();
-
+bool Database::initProgressForUser(QSqlDatabase db, int userId) {
     QSqlQuery q(db);
 
     // 1) Ensure a row exists for every quest (handles new quests added later)
     q.prepare(R"(
         INSERT OR IGNORE INTO quest_progress(user_id, quest_id, status)
-        SELECT ?, id, 'locked'
+        SELECT ?, id, ?
         FROM quests
     )");
     q.addBindValue(userId);
+    q.addBindValue(int(QuestLocked));
     if (!q.exec()) {
         qWarning() << "initProgressForUser insert failed:" << q.lastError().text();
         return false;
@@ -430,8 +1575,9 @@ bool Database::initProgressForUser(int userId) {
 
     // 2) If user has never progressed anything, unlock the first quest
     QSqlQuery chk(db);
-    chk.prepare("SELECT 1 FROM quest_progress WHERE user_id=? AND status!='locked' LIMIT 1");
+    chk.prepare("SELECT 1 FROM quest_progress WHERE user_id=? AND status!=? LIMIT 1");
     chk.addBindValue(userId);
+    chk.addBindValue(int(QuestLocked));
     if (!chk.exec()) {
         qWarning() << "initProgressForUser check failed:" << chk.lastError().text();
         return false;
@@ -442,10 +1588,11 @@ bool Database::initProgressForUser(int userId) {
         QSqlQuery up(db);
         up.prepare(R"(
             UPDATE quest_progress
-            SET status='unlocked'
+            SET status=?
             WHERE user_id=?
               AND quest_id=(SELECT MIN(id) FROM quests)
         )");
+        up.addBindValue(int(QuestUnlocked));
         up.addBindValue(userId);
         if (!up.exec()) {
             qWarning() << "initProgressForUser unlock failed:" << up.lastError().text();
@@ -457,3 +1604,69 @@ bool Database::initProgressForUser(int userId) {
 }
 
 
+
+int Database::createUser(QSqlDatabase db, const QString& username) {
+    // The user row commits on its own, before anything refers to it: a
+    // crash right after leaves a user without rows (see ensureUserRows),
+    // never rows of a user id that SQLite may hand out again.
+    QSqlQuery ins(db);
+    ins.prepare("INSERT INTO users(username, created_at, cohort) VALUES(?, ?, ?)");
+    ins.addBindValue(username);
+    ins.addBindValue(now());
+    const QString cohort = currentCohort();
+    ins.addBindValue(cohort.isEmpty() ? QVariant() : QVariant(cohort));
+    if (!ins.exec()) {
+        qWarning() << "createUser failed:" << ins.lastError().text();
+        return -1;
+    }
+    const int id = ins.lastInsertId().toInt();
+    return ensureUserRows(db, id) ? id : -1;
+}
+
+bool Database::ensureUserRows(QSqlDatabase db, int userId) {
+    QSqlQuery q(db);
+    q.prepare(R"(
+        SELECT 1 FROM user_stats s JOIN leaderboard_agg a ON a.user_id = s.user_id
+        WHERE s.user_id = ? AND a.total_xp = s.total_xp AND a.level = s.level
+          AND a.last_active IS s.last_active
+    )");
+    q.addBindValue(userId);
+    if (q.exec() && q.next()) return true;
+    q.finish();
+
+    return write(db, [&] {
+        if (!initProgressForUser(db, userId)) {
+            qWarning() << "Failed to init progress for user" << userId;
+            return false;
+        }
+        QSqlQuery st(db);
+        st.prepare("INSERT OR IGNORE INTO user_stats(user_id,total_xp,level,last_active) VALUES(?,0,1,?)");
+        st.addBindValue(userId);
+        st.addBindValue(now());
+        if (!st.exec()) {
+            qWarning() << "createUser stats failed:" << st.lastError().text();
+            return false;
+        }
+        return publishStats(db, userId);
+    }, "create user rows");
+}
+
+bool Database::dropNewUser(QSqlDatabase db, int userId) {
+    // The learner's rows first, the user row last: createUser() backwards.
+    auto remove = [db, userId](const std::initializer_list<const char*> &tables) {
+        for (const char* table : tables) {
+            QSqlQuery del(db);
+            del.prepare(QString("DELETE FROM %1 WHERE %2 = ?")
+                            .arg(QLatin1String(table),
+                                 QLatin1String(qstrcmp(table, "users") == 0 ? "id" : "user_id")));
+            del.addBindValue(userId);
+            if (!del.exec()) {
+                qWarning() << "drop user" << table << "failed:" << del.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    };
+    return write(db, [&] { return remove({"quest_progress", "user_stats"}); }, "drop user rows")
+        && write(db, [&] { return remove({"leaderboard_agg", "users"}); }, "drop user");
+}
@@ -0,0 +1,37 @@
+#include "eventbus.h"
+#include <QMetaObject>
+
+EventBus::EventBus(QObject *parent) : QObject(parent) {}
+
+void EventBus::subscribe(Events interest, Handler handler) {
+    m_subscribers.push_back({interest, std::move(handler)});
+}
+
+void EventBus::publish(Event e, const QString &message) {
+    m_pending |= e;
+    if (!message.isEmpty() && !m_messages.contains(message))
+        m_messages.append(message);
+    scheduleFlush();
+}
+
+void EventBus::scheduleFlush() {
+    if (m_flushQueued) return;
+    m_flushQueued = true;
+    QMetaObject::invokeMethod(this, &EventBus::flush, Qt::QueuedConnection);
+}
+
+void EventBus::flush() {
+    m_flushQueued = false;
+
+    // Take the batch first: handlers may publish again, which starts a new turn.
+    const Events events = m_pending;
+    const QStringList messages = m_messages;
+    m_pending = {};
+    m_messages.clear();
+
+    for (const auto &s : m_subscribers) {
+        if (s.interest & events) s.handler(events & s.interest);
+    }
+
+    if (!messages.isEmpty()) emit toast(messages.join('\n'));
+}
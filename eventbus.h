@@ -0,0 +1,52 @@
+#pragma once
+#include <QObject>
+#include <QStringList>
+#include <functional>
+#include <vector>
+
+// In-process domain event bus.
+// Publishers fire as many events as they like; subscribers run at most once
+// per event-loop turn, with the union of everything published in that turn.
+class EventBus : public QObject {
+    Q_OBJECT
+public:
+    enum Event {
+        AnswerGraded    = 0x1,
+        XpAwarded       = 0x2,
+        QuestCompleted  = 0x4,
+        DailyCompleted  = 0x8,
+        DailyProgressed = 0x10,
+        AchievementUnlocked = 0x20,
+    };
+    Q_DECLARE_FLAGS(Events, Event)
+    Q_FLAG(Events)
+
+    using Handler = std::function<void(Events)>;
+
+    explicit EventBus(QObject *parent = nullptr);
+
+    void subscribe(Events interest, Handler handler);
+
+    // Queue an event (and optionally a user-facing message) for this turn.
+    void publish(Event e, const QString &message = QString());
+
+signals:
+    // Messages published during one turn, joined into a single toast.
+    void toast(QString msg);
+
+private:
+    void scheduleFlush();
+    void flush();
+
+    struct Subscriber {
+        Events interest;
+        Handler handler;
+    };
+
+    std::vector<Subscriber> m_subscribers;
+    Events m_pending;
+    QStringList m_messages;
+    bool m_flushQueued = false;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(EventBus::Events)
@@ -1,25 +1,158 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
-#include <QQmlContext>
+#include <QQuickWindow>
 #include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QElapsedTimer>
+#include <QCommandLineParser>
+#include <QStandardPaths>
+#include <QFuture>
+#include <QtConcurrent/QtConcurrentRun>
 #include <QDebug>
 
 #include "Database.h"
 #include "AppController.h"
+#include "profileio.h"
+#include "analytics.h"
+#include "xpledger.h"
+#include "stresstest.h"
+#ifdef CODELEVELING_ALLOC_BENCH
+#include "allocbench.h"
+#endif
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// Peak resident memory of the process so far, in KiB; -1 if unknown.
+qint64 peakRssKiB() {
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return -1;
+    return qint64(pmc.PeakWorkingSetSize / 1024);
+#else
+    rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#if defined(Q_OS_DARWIN)
+    return qint64(ru.ru_maxrss / 1024);   // bytes there
+#else
+    return qint64(ru.ru_maxrss);
+#endif
+#endif
+}
+
+// Headless profile export/import for moving students and for graders, and
+// the analytics export for content authors. Returns -1 if none was given.
+int runCommand(const QCommandLineParser& parser) {
+    if (parser.isSet("export-profile")) {
+        const QString username = parser.value("export-profile");
+        const QString path = parser.isSet("file") ? parser.value("file") : username + ".cbor";
+
+        QSqlQuery q(Database::db());
+        q.prepare("SELECT id FROM users WHERE username = ?");
+        q.addBindValue(username);
+        if (!q.exec() || !q.next()) {
+            qCritical() << "No such user:" << username;
+            return 1;
+        }
+        const int userId = q.value(0).toInt();
+        q.finish();
+        if (!Database::useCohort(Database::cohortOf(Database::db(), userId))) return 1;
+        return ProfileIO::exportUser(userId, path) ? 0 : 1;
+    }
+    if (parser.isSet("import-profile")) {
+        return ProfileIO::importUser(parser.value("import-profile")) > 0 ? 0 : 1;
+    }
+    if (parser.isSet("export-analytics")) {
+        return Analytics::exportTo(Database::db(), parser.value("export-analytics")) ? 0 : 1;
+    }
+    if (parser.isSet("rebuild-stats")) {
+        bool ok = true;
+        for (const QString &cohort : QStringList{QString()} + Database::cohorts())
+            ok = Database::withCohort(cohort, &XpLedger::rebuildAllStats) && ok;
+        return ok ? 0 : 1;
+    }
+    if (parser.isSet("rebuild-analytics")) {
+        return Analytics::rebuildAll() ? 0 : 1;
+    }
+    return -1;
+}
+
+// Multi-process write stress against a scratch database, and its workers.
+// Runs before the real database is opened; returns -1 if not requested.
+int runStress(const QCommandLineParser& parser) {
+    const bool parent = parser.isSet("stress");
+    if (!parent && !parser.isSet("stress-worker")) return -1;
+
+    QStandardPaths::setTestModeEnabled(true);
+    if (parent) StressTest::removeScratchFiles();
+    if (!Database::init()) return 1;
+
+    if (parent) return StressTest::run(parser.value("stress").toInt());
+    return StressTest::worker(parser.value("stress-user").toInt(), parser.value("stress-worker").toInt());
+}
+
+} // namespace
 
 int main(int argc, char *argv[])
 {
+    QElapsedTimer startup;
+    startup.start();
+
     QGuiApplication app(argc, argv);
     qDebug() << "SQL drivers:" << QSqlDatabase::drivers();
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOptions({
+        {"export-profile", "Write a user's profile as CBOR and exit.", "username"},
+        {"file", "Output file for --export-profile (default <username>.cbor).", "path"},
+        {"import-profile", "Import a CBOR profile as a new user and exit.", "path"},
+        {"export-analytics", "Write question and quest analytics to a directory and exit.", "dir"},
+        {"rebuild-stats", "Recompute every user's XP and level from the ledger and exit."},
+        {"rebuild-analytics", "Recompute question and quest analytics from every cohort's history and exit."},
+        {"first-frame", "Exit once the first frame is shown and the startup timings are logged."},
+    });
+    QCommandLineOption stress("stress", "Run N processes writing to a scratch database, verify no update was lost and exit.", "processes");
+    QCommandLineOption stressWorker("stress-worker", "Internal: one --stress process.", "ops");
+    QCommandLineOption stressUser("stress-user", "Internal: user for --stress-worker.", "id");
+    stressWorker.setFlags(QCommandLineOption::HiddenFromHelp);
+    stressUser.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOption(stress);
+    parser.addOption(stressWorker);
+    parser.addOption(stressUser);
+#ifdef CODELEVELING_ALLOC_BENCH
+    parser.addOption({"bench-alloc", "Count heap allocations of the model refresh paths over N rounds and exit.", "rounds"});
+#endif
+    parser.process(app);
+
+    if (const int rc = runStress(parser); rc >= 0) return rc;
+
     if (!Database::init()) {
         return -1; // fail fast if DB cannot open
     }
 
-    AppController controller;
+    if (const int rc = runCommand(parser); rc >= 0) return rc;
+#ifdef CODELEVELING_ALLOC_BENCH
+    if (parser.isSet("bench-alloc")) return AllocBench::run(parser.value("bench-alloc").toInt());
+#endif
+    const qint64 dbReadyMs = startup.elapsed();
+
+    // From here on the main connection serves the UI: no sleeping on locks.
+    Database::setInteractive(true);
+
+    // Read the first screen's data while the QML engine loads
+    QFuture<AppController::StartupData> startupData =
+        QtConcurrent::run(&AppController::loadStartupData, QStringLiteral("LocalUser"));
+
+    AppController controller;   // exposed to QML as the App singleton
 
     QQmlApplicationEngine engine;
-    engine.rootContext()->setContextProperty("App", &controller);
 
     const QUrl url(QStringLiteral("qrc:/CodeLeveling/Main.qml"));
     QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
@@ -28,6 +161,23 @@ int main(int argc, char *argv[])
                      }, Qt::QueuedConnection);
 
     engine.load(url);
+    const qint64 qmlReadyMs = startup.elapsed();
+
+    controller.applyStartupData(startupData.result());
+
+    if (auto *window = qobject_cast<QQuickWindow *>(engine.rootObjects().value(0))) {
+        controller.trackFrames(window);
+        // --first-frame makes repeated startup measurements scriptable.
+        const bool exitAfter = parser.isSet("first-frame");
+        QObject::connect(window, &QQuickWindow::frameSwapped, &app,
+                         [&startup, dbReadyMs, qmlReadyMs, exitAfter] {
+                             qInfo().nospace() << "Startup: db ready " << dbReadyMs
+                                               << " ms, qml loaded " << qmlReadyMs
+                                               << " ms, first frame " << startup.elapsed()
+                                               << " ms, peak RSS " << peakRssKiB() << " KiB";
+                             if (exitAfter) QCoreApplication::quit();
+                         }, Qt::SingleShotConnection);
+    }
 
     return app.exec();
 }
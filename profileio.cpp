@@ -0,0 +1,454 @@
+#include "profileio.h"
+#include "Database.h"
+#include "analytics.h"
+#include "xpledger.h"
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QSaveFile>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <functional>
+
+namespace {
+
+const char kFormat[] = "codeleveling-profile";
+
+// Section -> column names, in file order. Values are integers or null.
+const char* const kProgressCols[] = {"quest_id", "status", "best_score", "last_attempt"};
+const char* const kAttemptCols[] = {"question_id", "timestamp", "is_correct", "answer"};
+const char* const kLedgerCols[] = {"source", "amount", "created_at"};
+const char* const kDailyCols[] = {"task_id", "day", "completed_at"};
+
+constexpr int kMaxCols = 4;
+
+struct Row {
+    qint64 v[kMaxCols] = {};
+    bool null[kMaxCols] = {};
+
+    QVariant value(int i) const { return null[i] ? QVariant() : QVariant(v[i]); }
+};
+
+// ---- Writing ----
+
+void appendValue(QCborStreamWriter& w, const QVariant& v) {
+    if (v.isNull()) w.appendNull();
+    else w.append(v.toLongLong());
+}
+
+// Streams every row of q as one table section.
+template <size_t N>
+bool writeTable(QCborStreamWriter& w, const char* section, const char* const (&cols)[N], QSqlQuery& q) {
+    w.append(QLatin1String(section));
+    w.startMap(2);
+    w.append(QLatin1String("columns"));
+    w.startArray(N);
+    for (const char* c : cols) w.append(QLatin1String(c));
+    w.endArray();
+
+    w.append(QLatin1String("rows"));
+    w.startArray();   // length unknown until the query is drained
+    while (q.next()) {
+        w.startArray(N);
+        for (size_t i = 0; i < N; ++i) appendValue(w, q.value(int(i)));
+        w.endArray();
+    }
+    w.endArray();
+    w.endMap();
+    return q.lastError().type() == QSqlError::NoError;
+}
+
+// ---- Reading ----
+
+// Consumes the string (all chunks); the reader ends up on the next item.
+QString readString(QCborStreamReader& r) {
+    if (!r.isString()) return QString();
+    QString out;
+    auto chunk = r.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        out += chunk.data;
+        chunk = r.readString();
+    }
+    return chunk.status == QCborStreamReader::EndOfString ? out : QString();
+}
+
+bool readInt(QCborStreamReader& r, qint64& out, bool& isNull) {
+    isNull = r.isNull();
+    if (isNull) {
+        out = 0;
+        return r.next();
+    }
+    if (!r.isInteger()) return false;
+    out = qint64(r.toInteger());
+    return r.next();
+}
+
+// Reads {"columns": [...], "rows": [...]} and hands each row to sink.
+template <size_t N>
+bool readTable(QCborStreamReader& r, const char* const (&cols)[N],
+               const std::function<bool(const Row&)>& sink, QString& error) {
+    if (!r.isMap() || !r.enterContainer()) {
+        error = "table is not a map";
+        return false;
+    }
+    bool sawColumns = false;
+    while (r.hasNext() && r.lastError() == QCborError::NoError) {
+        const QString key = readString(r);
+        if (key == QLatin1String("columns")) {
+            if (!r.isArray() || !r.enterContainer()) {
+                error = "columns is not an array";
+                return false;
+            }
+            size_t i = 0;
+            while (r.hasNext()) {
+                if (i >= N || readString(r) != QLatin1String(cols[i])) {
+                    error = "unexpected columns";
+                    return false;
+                }
+                ++i;
+            }
+            r.leaveContainer();
+            if (i != N) {
+                error = "unexpected columns";
+                return false;
+            }
+            sawColumns = true;
+        } else if (key == QLatin1String("rows")) {
+            if (!sawColumns) {
+                error = "rows before columns";
+                return false;
+            }
+            if (!r.isArray() || !r.enterContainer()) {
+                error = "rows is not an array";
+                return false;
+            }
+            while (r.hasNext()) {
+                if (!r.isArray() || !r.enterContainer()) {
+                    error = "row is not an array";
+                    return false;
+                }
+                Row row;
+                for (size_t i = 0; i < N; ++i) {
+                    if (!r.hasNext() || !readInt(r, row.v[i], row.null[i])) {
+                        error = "bad row";
+                        return false;
+                    }
+                }
+                if (r.hasNext() || !r.leaveContainer()) {
+                    error = "bad row";
+                    return false;
+                }
+                if (!sink(row)) return false;
+            }
+            r.leaveContainer();
+        } else {
+            r.next();   // unknown key: skip its value
+        }
+    }
+    if (!r.leaveContainer()) {
+        error = "bad table";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// ---- Export ----
+
+bool ProfileIO::exportUser(int userId, const QString& path, QString* error) {
+    auto fail = [error](const QString& msg) {
+        qWarning() << "profile export failed:" << msg;
+        if (error) *error = msg;
+        return false;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QSqlDatabase db = Database::threadDb();
+    QSqlQuery user(db);
+    user.prepare(R"(
+        SELECT u.username, u.created_at, s.total_xp, s.level, s.last_active
+        FROM users u LEFT JOIN user_stats s ON s.user_id = u.id
+        WHERE u.id = ?
+    )");
+    user.addBindValue(userId);
+    if (!user.exec()) return fail(user.lastError().text());
+    if (!user.next()) return fail("no such user");
+    // Per-learner rows are only visible while the learner's shard is open.
+    if (const QString cohort = Database::cohortOf(db, userId); cohort != Database::currentCohort())
+        return fail("user is in cohort " + (cohort.isEmpty() ? QStringLiteral("(none)") : cohort));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return fail(file.errorString());
+
+    // One read transaction: every section sees the same state.
+    db.transaction();
+
+    QCborStreamWriter w(&file);
+    w.startMap();
+    w.append(QLatin1String("format"));
+    w.append(QLatin1String(kFormat));
+    w.append(QLatin1String("version"));
+    w.append(qint64(kVersion));
+    w.append(QLatin1String("content"));
+    w.append(qint64(Database::kContentVersion));
+
+    w.append(QLatin1String("user"));
+    w.startMap(2);
+    w.append(QLatin1String("username"));
+    w.append(user.value(0).toString());
+    w.append(QLatin1String("created_at"));
+    appendValue(w, user.value(1));
+    w.endMap();
+
+    w.append(QLatin1String("stats"));
+    w.startMap(3);
+    w.append(QLatin1String("total_xp"));
+    appendValue(w, user.value(2));
+    w.append(QLatin1String("level"));
+    appendValue(w, user.value(3));
+    w.append(QLatin1String("last_active"));
+    appendValue(w, user.value(4));
+    w.endMap();
+
+    auto section = [&](const char* sql, auto write) {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(QString::fromLatin1(sql));
+        q.addBindValue(userId);
+        return q.exec() && write(q);
+    };
+
+    const bool ok =
+        section("SELECT quest_id, status, best_score, last_attempt FROM quest_progress WHERE user_id = ? ORDER BY quest_id",
+                [&](QSqlQuery& q) { return writeTable(w, "progress", kProgressCols, q); })
+        && section("SELECT question_id, timestamp, is_correct, answer FROM attempts_all WHERE user_id = ? ORDER BY timestamp, id",
+                   [&](QSqlQuery& q) { return writeTable(w, "attempts", kAttemptCols, q); })
+        && section("SELECT source, amount, created_at FROM xp_ledger WHERE user_id = ? ORDER BY id",
+                   [&](QSqlQuery& q) { return writeTable(w, "ledger", kLedgerCols, q); })
+        && section("SELECT task_id, day, completed_at FROM daily_completions WHERE user_id = ? ORDER BY day, task_id",
+                   [&](QSqlQuery& q) { return writeTable(w, "daily_completions", kDailyCols, q); });
+
+    w.endMap();
+    db.rollback();   // read-only; nothing to keep
+
+    if (!ok) {
+        file.cancelWriting();
+        return fail("query failed: " + db.lastError().text());
+    }
+    if (!file.commit()) return fail(file.errorString());
+
+    qInfo() << "profile export:" << path << QFile(path).size() << "bytes in" << timer.elapsed() << "ms";
+    return true;
+}
+
+// ---- Import ----
+
+int ProfileIO::importUser(const QString& path, QString* error) {
+    QString why;
+    auto fail = [&](const QString& msg) {
+        qWarning() << "profile import failed:" << msg;
+        if (error) *error = msg;
+        return -1;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return fail(file.errorString());
+
+    QCborStreamReader r(&file);
+    if (!r.isMap() || !r.enterContainer()) return fail("not a profile file");
+
+    QSqlDatabase db = Database::threadDb();
+    if (!Database::begin(db)) return fail(db.lastError().text());
+
+    int userId = -1;
+    qint64 rows = 0;
+    bool formatOk = false;
+
+    // Prepared once, bound per row.
+    QSqlQuery progress(db), attempt(db), ledger(db), daily(db);
+    progress.prepare(R"(
+        UPDATE quest_progress SET status = ?, best_score = ?, last_attempt = ?
+        WHERE user_id = ? AND quest_id = ?
+    )");
+    attempt.prepare("INSERT INTO attempts(user_id, question_id, timestamp, is_correct, answer) VALUES(?, ?, ?, ?, ?)");
+    ledger.prepare("INSERT INTO xp_ledger(user_id, source, amount, created_at) VALUES(?, ?, ?, ?)");
+    daily.prepare("INSERT OR IGNORE INTO daily_completions(user_id, task_id, day, completed_at) VALUES(?, ?, ?, ?)");
+
+    // Per-question attempt counts, folded into attempt_summary and the
+    // analytics counters at the end. Attempts arrive in timestamp order.
+    struct Summary {
+        qint64 attempts = 0, correct = 0, first = 0, last = 0;
+        bool firstTryCorrect = false;
+        qint64 attemptsToMastery = 0;
+    };
+    QHash<qint64, Summary> summary;
+    QHash<QPair<qint64, qint64>, qint64> picks;   // (question, choice) -> count
+    QList<qint64> completedQuests;
+
+    auto exec = [&](QSqlQuery& q) {
+        if (q.exec()) { ++rows; return true; }
+        why = q.lastError().text();
+        return false;
+    };
+    auto needUser = [&] {
+        if (userId <= 0) why = "rows before user";
+        return userId > 0;
+    };
+
+    bool ok = true;
+    while (ok && r.hasNext() && r.lastError() == QCborError::NoError) {
+        const QString key = readString(r);
+
+        if (key == QLatin1String("format")) {
+            formatOk = readString(r) == QLatin1String(kFormat);
+        } else if (key == QLatin1String("version") || key == QLatin1String("content")) {
+            qint64 v = 0;
+            bool isNull = false;
+            ok = readInt(r, v, isNull);
+            if (ok && key == QLatin1String("version") && v != kVersion) { why = "unsupported version"; ok = false; }
+            // Quest, question and task ids only line up within one content version.
+            if (ok && key == QLatin1String("content") && v != Database::kContentVersion) { why = "content version differs"; ok = false; }
+        } else if (key == QLatin1String("user")) {
+            QString username;
+            qint64 createdAt = 0;
+            bool noCreated = true;
+            ok = r.isMap() && r.enterContainer();
+            while (ok && r.hasNext()) {
+                const QString field = readString(r);
+                if (field == QLatin1String("username")) username = readString(r);
+                else if (field == QLatin1String("created_at")) ok = readInt(r, createdAt, noCreated);
+                else r.next();
+            }
+            ok = ok && r.leaveContainer() && formatOk && !username.isEmpty();
+            if (!ok) { why = "bad user header"; break; }
+
+            QSqlQuery exists(db);
+            exists.prepare("SELECT 1 FROM users WHERE username = ?");
+            exists.addBindValue(username);
+            if (!exists.exec()) { why = exists.lastError().text(); ok = false; break; }
+            if (exists.next()) { why = "user already exists: " + username; ok = false; break; }
+
+            // The user row lives in the shared file and commits on its own
+            // (see Database::createUser); nothing was written before it.
+            db.rollback();
+            userId = Database::createUser(db, username);
+            if (userId <= 0) { why = "cannot create user"; ok = false; break; }
+            if (!noCreated) {
+                QSqlQuery up(db);
+                up.prepare("UPDATE users SET created_at = ? WHERE id = ?");
+                up.addBindValue(createdAt);
+                up.addBindValue(userId);
+                ok = up.exec();
+            }
+            if (ok && !Database::begin(db)) { why = "database busy"; ok = false; }
+        } else if (key == QLatin1String("progress")) {
+            ok = needUser() && readTable(r, kProgressCols, [&](const Row& row) {
+                progress.bindValue(0, row.value(1));
+                progress.bindValue(1, row.value(2));
+                progress.bindValue(2, row.value(3));
+                progress.bindValue(3, userId);
+                progress.bindValue(4, row.value(0));
+                if (!row.null[1] && row.v[1] == Database::QuestCompleted) completedQuests.append(row.v[0]);
+                return exec(progress);
+            }, why);
+        } else if (key == QLatin1String("attempts")) {
+            ok = needUser() && readTable(r, kAttemptCols, [&](const Row& row) {
+                attempt.bindValue(0, userId);
+                attempt.bindValue(1, row.value(0));
+                attempt.bindValue(2, row.value(1));
+                attempt.bindValue(3, row.value(2));
+                attempt.bindValue(4, row.value(3));
+
+                Summary &s = summary[row.v[0]];
+                if (s.attempts == 0) s.firstTryCorrect = row.v[2] != 0;
+                s.first = s.attempts ? qMin(s.first, row.v[1]) : row.v[1];
+                s.last = qMax(s.last, row.v[1]);
+                ++s.attempts;
+                if (row.v[2] && s.correct == 0) s.attemptsToMastery = s.attempts;
+                s.correct += row.v[2] ? 1 : 0;
+                if (!row.null[3]) ++picks[qMakePair(row.v[0], row.v[3])];
+                return exec(attempt);
+            }, why);
+        } else if (key == QLatin1String("ledger")) {
+            ok = needUser() && readTable(r, kLedgerCols, [&](const Row& row) {
+                ledger.bindValue(0, userId);
+                ledger.bindValue(1, row.value(0));
+                ledger.bindValue(2, row.value(1));
+                ledger.bindValue(3, row.value(2));
+                return exec(ledger);
+            }, why);
+        } else if (key == QLatin1String("daily_completions")) {
+            ok = needUser() && readTable(r, kDailyCols, [&](const Row& row) {
+                daily.bindValue(0, userId);
+                daily.bindValue(1, row.value(0));
+                daily.bindValue(2, row.value(1));
+                daily.bindValue(3, row.value(2));
+                return exec(daily);
+            }, why);
+        } else {
+            r.next();   // "stats" is derived from the ledger; unknown keys are skipped
+        }
+    }
+
+    if (ok && r.lastError() != QCborError::NoError) {
+        why = r.lastError().toString();
+        ok = false;
+    }
+    if (ok && userId <= 0) {
+        why = "no user in file";
+        ok = false;
+    }
+
+    if (ok) {
+        QSqlQuery sum(db);
+        sum.prepare(R"(
+            INSERT INTO attempt_summary(user_id, question_id, attempts, correct, first_ts, last_ts)
+            VALUES(?, ?, ?, ?, ?, ?)
+        )");
+        for (auto it = summary.cbegin(); ok && it != summary.cend(); ++it) {
+            sum.bindValue(0, userId);
+            sum.bindValue(1, it.key());
+            sum.bindValue(2, it->attempts);
+            sum.bindValue(3, it->correct);
+            sum.bindValue(4, it->first);
+            sum.bindValue(5, it->last);
+            ok = sum.exec();
+            if (!ok) why = sum.lastError().text();
+
+            Analytics::QuestionDelta d;
+            d.attempts = it->attempts;
+            d.correct = it->correct;
+            d.firstTryCorrect = it->firstTryCorrect;
+            d.attemptsToMastery = it->attemptsToMastery;
+            ok = ok && Analytics::addLearner(db, int(it.key()), d);
+        }
+        for (auto it = picks.cbegin(); ok && it != picks.cend(); ++it)
+            ok = Analytics::addPicks(db, int(it.key().first), int(it.key().second), it.value());
+        ok = ok && Analytics::questsStartedBy(db, userId);
+        for (qint64 questId : std::as_const(completedQuests))
+            ok = ok && Analytics::questCompleted(db, int(questId));
+        if (!ok && why.isEmpty()) why = "analytics update failed";
+        ok = ok && XpLedger::refreshStats(db, userId);
+    }
+
+    if (!ok || !db.commit()) {
+        db.rollback();
+        // The users row committed on its own; take it back with the rest.
+        if (userId > 0) Database::dropNewUser(db, userId);
+        return fail(why.isEmpty() ? db.lastError().text() : why);
+    }
+
+    qInfo() << "profile import:" << rows << "rows from" << path << "in" << timer.elapsed() << "ms";
+    return userId;
+}
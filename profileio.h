@@ -0,0 +1,21 @@
+#pragma once
+#include <QString>
+
+// One user's full profile as a CBOR file: stats, quest progress, every
+// attempt (hot and archived), XP ledger and daily completions.
+// Both directions stream row by row (forward-only queries on one side,
+// QCborStreamReader on the other), so memory does not grow with history.
+//
+// Layout: a map with "format", "version", "content", "user", "stats", then
+// one table per section: {"columns": [names], "rows": [[values], ...]}.
+class ProfileIO {
+public:
+    static constexpr int kVersion = 1;
+
+    // Both work on the calling thread's connection (Database::threadDb()),
+    // so they may run on a worker.
+    static bool exportUser(int userId, const QString& path, QString* error = nullptr);
+    // Creates the user under new ids in one transaction; fails if the
+    // username already exists. Returns the new user id, or -1.
+    static int importUser(const QString& path, QString* error = nullptr);
+};
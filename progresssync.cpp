@@ -0,0 +1,586 @@
+#include "progresssync.h"
+#include "Database.h"
+#include "analytics.h"
+#include "xpledger.h"
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUuid>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QVector>
+#include <QDebug>
+
+namespace {
+
+struct Delta {
+    QString machine;
+    qint64 seq = 0;
+    qint32 content = 0;        // Database::kContentVersion of the writer
+    QString username;
+    qint64 lastActive = -1;    // -1: never
+
+    struct Attempt { qint32 questionId; qint64 ts; quint8 correct; qint32 answer; };
+    struct Ledger { quint8 source; qint32 amount; qint64 createdAt; qint32 ref; qint64 day; };   // 0: none
+    struct Progress { qint32 questId; quint8 status; qint32 bestScore; qint64 lastAttempt; };
+    struct Daily { qint32 taskId; qint64 day; qint64 completedAt; };
+
+    QVector<Attempt> attempts;
+    QVector<Ledger> ledger;
+    QVector<Progress> progress;
+    QVector<Daily> dailies;
+
+    int rows() const { return attempts.size() + ledger.size() + dailies.size(); }
+};
+
+constexpr QDataStream::Version kStreamVersion = QDataStream::Qt_6_5;
+
+QByteArray encode(const Delta& d) {
+    QByteArray raw;
+    QDataStream out(&raw, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+
+    out << d.machine << d.seq << d.content << d.username << d.lastActive;
+    out << quint32(d.attempts.size());
+    for (const auto &a : d.attempts) out << a.questionId << a.ts << a.correct << a.answer;
+    out << quint32(d.ledger.size());
+    for (const auto &l : d.ledger) out << l.source << l.amount << l.createdAt << l.ref << l.day;
+    out << quint32(d.progress.size());
+    for (const auto &p : d.progress) out << p.questId << p.status << p.bestScore << p.lastAttempt;
+    out << quint32(d.dailies.size());
+    for (const auto &t : d.dailies) out << t.taskId << t.day << t.completedAt;
+    return raw;
+}
+
+bool decode(const QByteArray& raw, quint16 format, Delta& d) {
+    QDataStream in(raw);
+    in.setVersion(kStreamVersion);
+
+    // Counts come from the file; read element by element instead of reserving.
+    quint32 n = 0;
+    in >> d.machine >> d.seq >> d.content >> d.username >> d.lastActive;
+    in >> n;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i) {
+        Delta::Attempt a;
+        in >> a.questionId >> a.ts >> a.correct >> a.answer;
+        d.attempts.append(a);
+    }
+    in >> n;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i) {
+        Delta::Ledger l{};
+        in >> l.source >> l.amount >> l.createdAt;
+        if (format >= 2) in >> l.ref >> l.day;
+        d.ledger.append(l);
+    }
+    in >> n;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i) {
+        Delta::Progress p;
+        in >> p.questId >> p.status >> p.bestScore >> p.lastAttempt;
+        d.progress.append(p);
+    }
+    in >> n;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i) {
+        Delta::Daily t;
+        in >> t.taskId >> t.day >> t.completedAt;
+        d.dailies.append(t);
+    }
+    return in.status() == QDataStream::Ok && !d.machine.isEmpty() && !d.username.isEmpty();
+}
+
+} // namespace
+
+QString ProgressSync::defaultDir() {
+    const QString env = qEnvironmentVariable("CODELEVELING_SYNC_DIR");
+    if (!env.isEmpty()) return env;
+    return QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + "/CodeLeveling Sync";
+}
+
+QString ProgressSync::machineId(QSqlDatabase db) {
+    QSqlQuery q(db);
+    if (q.exec("SELECT value FROM sync_state WHERE key = 'machine_id'") && q.next())
+        return q.value(0).toString();
+
+    const QString id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    QSqlQuery ins(db);
+    ins.prepare("INSERT INTO sync_state(key, value) VALUES('machine_id', ?)");
+    ins.addBindValue(id);
+    if (!ins.exec()) {
+        qWarning() << "sync: cannot store machine id:" << ins.lastError().text();
+        return QString();
+    }
+    return id;
+}
+
+qint64 ProgressSync::nextSeq(QSqlDatabase db) {
+    QSqlQuery q(db);
+    if (!q.exec("SELECT value FROM sync_state WHERE key = 'next_seq'")) return -1;
+    const qint64 seq = q.next() ? q.value(0).toLongLong() : 1;
+
+    QSqlQuery up(db);
+    up.prepare(R"(
+        INSERT INTO sync_state(key, value) VALUES('next_seq', ?)
+        ON CONFLICT(key) DO UPDATE SET value = excluded.value
+    )");
+    up.addBindValue(seq + 1);
+    if (!up.exec()) {
+        qWarning() << "sync: cannot advance sequence:" << up.lastError().text();
+        return -1;
+    }
+    return seq;
+}
+
+int ProgressSync::peerId(QSqlDatabase db, const QString& machine) {
+    QSqlQuery ins(db);
+    ins.prepare("INSERT OR IGNORE INTO sync_peers(machine) VALUES(?)");
+    ins.addBindValue(machine);
+
+    QSqlQuery q(db);
+    q.prepare("SELECT id FROM sync_peers WHERE machine = ?");
+    q.addBindValue(machine);
+    if (!ins.exec() || !q.exec() || !q.next()) {
+        qWarning() << "sync: peer lookup failed:" << ins.lastError().text() << q.lastError().text();
+        return -1;
+    }
+    return q.value(0).toInt();
+}
+
+// ---- Export ----
+
+int ProgressSync::exportUser(int userId, const QString& dir) {
+    if (userId <= 0) return -1;
+    if (!QDir().mkpath(dir)) {
+        qWarning() << "sync: cannot create" << dir;
+        return -1;
+    }
+
+    QSqlDatabase db = Database::threadDb();
+    Delta d;
+    d.machine = machineId(db);
+    d.content = Database::kContentVersion;
+    if (d.machine.isEmpty()) return -1;
+
+    // The sequence is in the shared file, the watermarks in the learner's
+    // shard; files commit one by one. Taking the number in its own
+    // transaction first means a crash can only skip a number, never reuse
+    // one a peer has already marked as seen.
+    if (!Database::write(db, [&] { return (d.seq = nextSeq(db)) > 0; }, "sync: reserve sequence"))
+        return -1;
+
+    // Rows are read in a read transaction, which holds up no writer in WAL
+    // mode, and the file is written with no transaction open at all.
+    if (!db.transaction()) {
+        qWarning() << "sync export failed:" << db.lastError().text();
+        return -1;
+    }
+    auto fail = [&db](const QSqlQuery& q) {
+        qWarning() << "sync export failed:" << q.lastError().text();
+        db.rollback();
+        return -1;
+    };
+
+    qint64 attemptMark = 0, ledgerMark = 0, dailyMark = 0;
+    {
+        QSqlQuery q(db);
+        q.prepare(R"(
+            SELECT u.username, s.last_active, w.attempt_id, w.ledger_id, w.completion_id
+            FROM users u
+            LEFT JOIN user_stats s ON s.user_id = u.id
+            LEFT JOIN sync_watermarks w ON w.user_id = u.id
+            WHERE u.id = ?
+        )");
+        q.addBindValue(userId);
+        if (!q.exec()) return fail(q);
+        if (!q.next()) {
+            db.rollback();
+            return -1;
+        }
+        d.username = q.value(0).toString();
+        d.lastActive = q.value(1).isNull() ? -1 : q.value(1).toLongLong();
+        attemptMark = q.value(2).toLongLong();
+        ledgerMark = q.value(3).toLongLong();
+        dailyMark = q.value(4).toLongLong();
+    }
+    const qint64 attemptFrom = attemptMark, ledgerFrom = ledgerMark, dailyFrom = dailyMark;
+
+    // Only rows recorded on this machine; imported ones belong to their origin.
+    {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(R"(
+            SELECT id, question_id, timestamp, is_correct, answer
+            FROM attempts_all
+            WHERE user_id = ? AND origin = 0 AND id > ?
+            ORDER BY id
+        )");
+        q.addBindValue(userId);
+        q.addBindValue(attemptMark);
+        if (!q.exec()) return fail(q);
+        while (q.next()) {
+            attemptMark = q.value(0).toLongLong();
+            d.attempts.append({q.value(1).toInt(), q.value(2).toLongLong(),
+                               quint8(q.value(3).toInt()), q.value(4).toInt()});
+        }
+    }
+    {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(R"(
+            SELECT id, source, amount, created_at, COALESCE(ref, 0), COALESCE(day, 0)
+            FROM xp_ledger
+            WHERE user_id = ? AND origin = 0 AND id > ?
+            ORDER BY id
+        )");
+        q.addBindValue(userId);
+        q.addBindValue(ledgerMark);
+        if (!q.exec()) return fail(q);
+        while (q.next()) {
+            ledgerMark = q.value(0).toLongLong();
+            d.ledger.append({quint8(q.value(1).toInt()), q.value(2).toInt(), q.value(3).toLongLong(),
+                             q.value(4).toInt(), q.value(5).toLongLong()});
+        }
+    }
+    {
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(R"(
+            SELECT id, task_id, day, completed_at
+            FROM daily_completions
+            WHERE user_id = ? AND origin = 0 AND id > ?
+            ORDER BY id
+        )");
+        q.addBindValue(userId);
+        q.addBindValue(dailyMark);
+        if (!q.exec()) return fail(q);
+        while (q.next()) {
+            dailyMark = q.value(0).toLongLong();
+            d.dailies.append({q.value(1).toInt(), q.value(2).toLongLong(), q.value(3).toLongLong()});
+        }
+    }
+
+    const int rows = d.rows();
+    if (rows == 0) {
+        db.rollback();
+        return 0;
+    }
+
+    // Progress is a handful of rows per user and merges by max, so send it whole.
+    {
+        QSqlQuery q(db);
+        q.prepare(R"(
+            SELECT quest_id, status, best_score, last_attempt
+            FROM quest_progress
+            WHERE user_id = ? AND status > ?
+        )");
+        q.addBindValue(userId);
+        q.addBindValue(int(Database::QuestLocked));
+        if (!q.exec()) return fail(q);
+        while (q.next()) {
+            d.progress.append({q.value(0).toInt(), quint8(q.value(1).toInt()), q.value(2).toInt(),
+                               q.value(3).isNull() ? -1 : q.value(3).toLongLong()});
+        }
+    }
+
+    db.rollback();   // read only
+
+    // Write the file first; the watermarks only move if it landed.
+    const QString path = QDir(dir).filePath(QString("%1-%2.clsync").arg(d.machine).arg(d.seq, 8, 10, QChar('0')));
+    QSaveFile file(path);
+    if (file.open(QIODevice::WriteOnly)) {
+        QDataStream out(&file);
+        out.setVersion(kStreamVersion);
+        out << kMagic << kFormat << qCompress(encode(d), 9);
+    }
+    if (!file.commit()) {
+        qWarning() << "sync: cannot write" << path << file.errorString();
+        return -1;
+    }
+
+    // Only from the marks the rows were read after: if another export of
+    // this learner (another instance) moved them meanwhile, it sent these
+    // rows too and this file is dropped.
+    bool moved = false;
+    const bool ok = Database::write(db, [&] {
+        QSqlQuery mark(db);
+        mark.prepare(R"(
+            INSERT INTO sync_watermarks(user_id, attempt_id, ledger_id, completion_id) VALUES(?, ?, ?, ?)
+            ON CONFLICT(user_id) DO UPDATE SET
+                attempt_id = excluded.attempt_id,
+                ledger_id = excluded.ledger_id,
+                completion_id = excluded.completion_id
+            WHERE attempt_id = ? AND ledger_id = ? AND completion_id = ?
+        )");
+        mark.addBindValue(userId);
+        mark.addBindValue(attemptMark);
+        mark.addBindValue(ledgerMark);
+        mark.addBindValue(dailyMark);
+        mark.addBindValue(attemptFrom);
+        mark.addBindValue(ledgerFrom);
+        mark.addBindValue(dailyFrom);
+        if (!mark.exec()) {
+            qWarning() << "sync export failed:" << mark.lastError().text();
+            return false;
+        }
+        moved = mark.numRowsAffected() == 0;
+        return true;
+    }, "sync: move watermarks");
+    if (!ok || moved) {
+        QFile::remove(path);
+        if (moved) qInfo() << "sync: another export of user" << userId << "ran meanwhile; dropped" << path;
+        return ok ? 0 : -1;
+    }
+
+    qInfo() << "sync: exported" << rows << "rows to" << path;
+    return rows;
+}
+
+// ---- Import ----
+
+int ProgressSync::importDir(const QString& dir, QList<int>* touchedUsers) {
+    QSqlDatabase db = Database::threadDb();
+    const QString self = machineId(db);
+    if (self.isEmpty()) return -1;
+
+    const QDir folder(dir);
+    const QStringList files = folder.entryList({QStringLiteral("*.clsync")}, QDir::Files, QDir::Name);
+
+    int merged = 0;
+    bool failed = false;
+    for (const QString &name : files) {
+        if (name.startsWith(self + '-')) continue;   // our own exports
+
+        // One bad file should not keep the others from merging.
+        int userId = -1;
+        const int r = importFile(db, folder.filePath(name), self, userId);
+        if (r < 0) failed = true;
+        if (r <= 0) continue;
+
+        ++merged;
+        if (touchedUsers && !touchedUsers->contains(userId)) touchedUsers->append(userId);
+    }
+    return failed ? -1 : merged;
+}
+
+int ProgressSync::importFile(QSqlDatabase db, const QString& path, const QString& self, int& userId) {
+    Delta d;
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "sync: cannot read" << path << file.errorString();
+            return -1;
+        }
+        QDataStream in(&file);
+        in.setVersion(kStreamVersion);
+        quint32 magic = 0;
+        quint16 format = 0;
+        QByteArray packed;
+        in >> magic >> format;
+        if (magic != kMagic || format < 1 || format > kFormat) {
+            qWarning() << "sync: not a progress delta:" << path;
+            return -1;
+        }
+        in >> packed;
+        if (in.status() != QDataStream::Ok || !decode(qUncompress(packed), format, d)) {
+            qWarning() << "sync: corrupt delta:" << path;
+            return -1;
+        }
+    }
+
+    if (d.machine == self) return 0;
+    if (d.content != Database::kContentVersion) {
+        // Question and task ids only line up between identical content versions.
+        qWarning() << "sync: skipping" << path << "- content version" << d.content
+                   << "vs" << Database::kContentVersion;
+        return 0;
+    }
+
+    // Shared-file rows this import refers to are created first, each
+    // committed on its own: a crash must not leave the learner's rows
+    // pointing at a peer or user id that was rolled back and can be handed
+    // out again. The rows and the mark that they were merged then commit
+    // together in the learner's shard.
+    const int peer = peerId(db, d.machine);
+    if (peer < 0) return -1;
+    {
+        QSqlQuery q(db);
+        q.prepare("SELECT id FROM users WHERE username = ?");
+        q.addBindValue(d.username);
+        if (!q.exec()) {
+            qWarning() << "sync import of" << path << "failed:" << q.lastError().text();
+            return -1;
+        }
+        userId = q.next() ? q.value(0).toInt() : -1;
+    }
+
+    // Their rows belong in another cohort's shard: leave the file unmarked
+    // so it merges once one of that cohort's learners is current.
+    if (userId > 0) {
+        if (const QString cohort = Database::cohortOf(db, userId); cohort != Database::currentCohort()) {
+            qInfo() << "sync: deferring" << path << "until cohort" << cohort << "is open";
+            return 0;
+        }
+    } else if ((userId = Database::createUser(db, d.username)) <= 0) {
+        return -1;
+    }
+
+    if (!Database::begin(db)) return -1;
+    auto fail = [&](const QSqlQuery& q) {
+        qWarning() << "sync import of" << path << "failed:" << q.lastError().text();
+        db.rollback();
+        return -1;
+    };
+
+    {
+        QSqlQuery seen(db);
+        seen.prepare("SELECT 1 FROM sync_imports WHERE peer_id = ? AND seq = ?");
+        seen.addBindValue(peer);
+        seen.addBindValue(d.seq);
+        if (!seen.exec()) return fail(seen);
+        if (seen.next()) {
+            db.rollback();
+            return 0;
+        }
+    }
+
+    // Attempts: union. The summary and author counters absorb them like
+    // locally answered ones.
+    for (const auto &a : d.attempts) {
+        Analytics::Attempt at;
+        at.userId = userId;
+        at.questionId = a.questionId;
+        at.timestamp = a.ts;
+        at.correct = a.correct;
+        at.answer = a.answer;
+        at.origin = peer;
+        if (!Analytics::recordAttempt(db, at)) {
+            db.rollback();
+            return -1;
+        }
+    }
+
+    // XP: union of ledger rows, except completion XP another machine
+    // already brought in (see the header); the cached total is recomputed below.
+    int dropped = 0;
+    {
+        QSqlQuery ins(db);
+        ins.prepare(R"(
+            INSERT INTO xp_ledger(user_id, source, amount, created_at, origin, ref, day)
+            VALUES(?, ?, ?, ?, ?, ?, ?)
+        )");
+        QSqlQuery dup(db);
+        dup.prepare(R"(
+            SELECT 1 FROM xp_ledger
+            WHERE user_id = ? AND source = ? AND ref = ? AND day = ? AND origin <> ?
+            LIMIT 1
+        )");
+        for (const auto &l : d.ledger) {
+            const bool keyed = (l.source == XpLedger::Quest || l.source == XpLedger::Daily) && l.ref > 0 && l.day > 0;
+            if (keyed) {
+                dup.bindValue(0, userId);
+                dup.bindValue(1, int(l.source));
+                dup.bindValue(2, l.ref);
+                dup.bindValue(3, l.day);
+                dup.bindValue(4, peer);
+                if (!dup.exec()) return fail(dup);
+                const bool seen = dup.next();
+                dup.finish();
+                if (seen) {
+                    ++dropped;
+                    continue;
+                }
+            }
+
+            ins.bindValue(0, userId);
+            ins.bindValue(1, int(l.source));
+            ins.bindValue(2, l.amount);
+            ins.bindValue(3, l.createdAt);
+            ins.bindValue(4, peer);
+            ins.bindValue(5, keyed ? QVariant(l.ref) : QVariant());
+            ins.bindValue(6, l.day > 0 ? QVariant(l.day) : QVariant());
+            if (!ins.exec()) return fail(ins);
+        }
+    }
+
+    // Progress: the furthest state either machine reached.
+    {
+        QSqlQuery up(db);
+        up.prepare(R"(
+            INSERT INTO quest_progress(user_id, quest_id, status, best_score, last_attempt)
+            VALUES(?, ?, ?, ?, ?)
+            ON CONFLICT(user_id, quest_id) DO UPDATE SET
+                status = MAX(status, excluded.status),
+                best_score = MAX(best_score, excluded.best_score),
+                last_attempt = MAX(COALESCE(last_attempt, excluded.last_attempt),
+                                   COALESCE(excluded.last_attempt, last_attempt))
+        )");
+        QSqlQuery prev(db);
+        prev.prepare("SELECT status FROM quest_progress WHERE user_id = ? AND quest_id = ?");
+        for (const auto &p : d.progress) {
+            prev.bindValue(0, userId);
+            prev.bindValue(1, p.questId);
+            if (!prev.exec()) return fail(prev);
+            const int before = prev.next() ? prev.value(0).toInt() : 0;
+
+            up.bindValue(0, userId);
+            up.bindValue(1, p.questId);
+            up.bindValue(2, int(p.status));
+            up.bindValue(3, p.bestScore);
+            up.bindValue(4, p.lastAttempt < 0 ? QVariant() : QVariant(p.lastAttempt));
+            if (!up.exec()) return fail(up);
+
+            if (p.status == Database::QuestCompleted && before != Database::QuestCompleted
+                && !Analytics::questCompleted(db, p.questId)) {
+                db.rollback();
+                return -1;
+            }
+        }
+    }
+
+    {
+        QSqlQuery ins(db);
+        ins.prepare(R"(
+            INSERT OR IGNORE INTO daily_completions(user_id, task_id, day, completed_at, origin)
+            VALUES(?, ?, ?, ?, ?)
+        )");
+        for (const auto &t : d.dailies) {
+            ins.bindValue(0, userId);
+            ins.bindValue(1, t.taskId);
+            ins.bindValue(2, t.day);
+            ins.bindValue(3, t.completedAt);
+            ins.bindValue(4, peer);
+            if (!ins.exec()) return fail(ins);
+        }
+    }
+
+    if (d.lastActive >= 0) {
+        QSqlQuery up(db);
+        up.prepare("UPDATE user_stats SET last_active = MAX(COALESCE(last_active, 0), ?) WHERE user_id = ?");
+        up.addBindValue(d.lastActive);
+        up.addBindValue(userId);
+        if (!up.exec()) return fail(up);
+    }
+
+    if (!XpLedger::refreshStats(db, userId)) {
+        db.rollback();
+        return -1;
+    }
+
+    QSqlQuery done(db);
+    done.prepare("INSERT INTO sync_imports(peer_id, seq, imported_at) VALUES(?, ?, ?)");
+    done.addBindValue(peer);
+    done.addBindValue(d.seq);
+    done.addBindValue(Database::now());
+    if (!done.exec()) return fail(done);
+
+    if (!db.commit()) {
+        qWarning() << "sync: commit failed:" << db.lastError().text();
+        db.rollback();
+        return -1;
+    }
+
+    qInfo() << "sync: merged" << d.rows() - dropped << "rows for" << d.username << "from" << path;
+    if (dropped > 0) qInfo() << "sync:" << dropped << "completion XP rows were already counted";
+    return 1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <QSqlDatabase>
+#include <QString>
+#include <QList>
+
+// Progress sync between machines through a shared folder or USB stick.
+// Each export writes one compressed delta file, <machine>-<seq>.clsync,
+// holding only rows this machine recorded for the user since its last
+// export. Import merges every file it has not seen before:
+//   attempts, XP ledger rows  - union (totals are recomputed from the ledger)
+//   quest progress            - max status, max best_score
+//   daily completions         - union
+// Users are matched by username. Imported rows keep their origin, so they
+// are never exported again and merging the same file twice is a no-op.
+//
+// XP for completing a quest or daily task is the exception to the union:
+// for each (user, source, quest or task, day) only one machine's rows
+// count. A peer's Quest or Daily row is dropped when rows for the same key
+// already came from elsewhere (this machine or another peer); its own
+// repeats on one day are kept, as they were earned. Rows from before
+// format 2 carry no key and are always merged.
+class ProgressSync {
+public:
+    static QString defaultDir();
+
+    // Both run on the calling thread's connection (Database::threadDb()).
+    // Returns the number of rows exported (0: nothing new, no file written), or -1.
+    static int exportUser(int userId, const QString& dir);
+    // Returns the number of files merged, or -1 if any of them failed.
+    // touchedUsers receives the local ids of users whose progress changed.
+    static int importDir(const QString& dir, QList<int>* touchedUsers = nullptr);
+
+private:
+    static constexpr quint32 kMagic = 0x434c5359;   // "CLSY"
+    static constexpr quint16 kFormat = 2;   // 2: ledger rows carry ref and day
+
+    static QString machineId(QSqlDatabase db);
+    static qint64 nextSeq(QSqlDatabase db);
+    static int peerId(QSqlDatabase db, const QString& machine);
+    // 1: merged, 0: skipped (own, seen or incompatible file), -1: failed
+    static int importFile(QSqlDatabase db, const QString& path, const QString& self, int& userId);
+};
@@ -0,0 +1,334 @@
+#include "responsetimes.h"
+#include "Database.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QVariantList>
+#include <QDebug>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int kHalf = 1 << (TimeHistogram::kSubBits - 1);   // buckets per power of two
+constexpr char kFormat = 1;                                  // first byte of a stored blob
+
+void putVarint(QByteArray &out, quint64 v) {
+    while (v >= 0x80) {
+        out.append(char((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.append(char(v));
+}
+
+bool getVarint(const QByteArray &in, qsizetype &pos, quint64 &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        const uchar c = uchar(in[pos++]);
+        v |= quint64(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+QVariantMap summary(const TimeHistogram &h) {
+    QVariantMap m;
+    m["samples"] = qint64(h.count());
+    m["p50"] = h.percentile(50);
+    m["p90"] = h.percentile(90);
+    m["p99"] = h.percentile(99);
+    m["max"] = h.max();
+    return m;
+}
+
+} // namespace
+
+// ---- TimeHistogram ----
+
+int TimeHistogram::bucketOf(qint64 ms) {
+    const quint64 v = quint64(qBound<qint64>(0, ms, kMaxMs));
+    if (v < quint64(2 * kHalf)) return int(v);
+    const int shift = 63 - qCountLeadingZeroBits(v) - (kSubBits - 1);
+    return shift * kHalf + int(v >> shift);
+}
+
+qint64 TimeHistogram::lowerBound(int bucket) {
+    if (bucket < 2 * kHalf) return bucket;
+    const int shift = bucket / kHalf - 1;
+    return qint64(bucket % kHalf + kHalf) << shift;
+}
+
+void TimeHistogram::add(qint64 ms, quint64 n) {
+    if (n == 0) return;
+    const int b = bucketOf(ms);
+    if (m_counts.size() <= b) m_counts.resize(b + 1);
+    m_counts[b] += n;
+    m_total += n;
+}
+
+void TimeHistogram::merge(const TimeHistogram &other) {
+    if (m_counts.size() < other.m_counts.size()) m_counts.resize(other.m_counts.size());
+    for (int b = 0; b < other.m_counts.size(); ++b) m_counts[b] += other.m_counts[b];
+    m_total += other.m_total;
+}
+
+qint64 TimeHistogram::percentile(double p) const {
+    if (m_total == 0) return 0;
+    const quint64 rank = qMax<quint64>(1, quint64(std::ceil(qBound(0.0, p, 100.0) / 100.0 * m_total)));
+    quint64 seen = 0;
+    for (int b = 0; b < m_counts.size(); ++b) {
+        seen += m_counts[b];
+        if (seen >= rank) return qMin(lowerBound(b + 1) - 1, kMaxMs);
+    }
+    return kMaxMs;
+}
+
+QByteArray TimeHistogram::encode() const {
+    QByteArray out;
+    out.append(kFormat);
+    int previous = -1;
+    for (int b = 0; b < m_counts.size(); ++b) {
+        if (!m_counts[b]) continue;
+        putVarint(out, quint64(b - previous - 1));
+        putVarint(out, m_counts[b]);
+        previous = b;
+    }
+    return out;
+}
+
+TimeHistogram TimeHistogram::decode(const QByteArray &blob) {
+    TimeHistogram h;
+    if (blob.isEmpty()) return h;
+    if (blob[0] != kFormat) {
+        qWarning() << "time histogram: unknown format" << int(blob[0]);
+        return h;
+    }
+
+    static const int kBuckets = bucketOf(kMaxMs) + 1;
+    qsizetype pos = 1;
+    int previous = -1;
+    while (pos < blob.size()) {
+        quint64 gap = 0, n = 0;
+        if (!getVarint(blob, pos, gap) || !getVarint(blob, pos, n) || gap >= quint64(kBuckets)
+            || previous + 1 + int(gap) >= kBuckets) {
+            qWarning() << "time histogram: corrupt blob";
+            return TimeHistogram();
+        }
+        previous += 1 + int(gap);
+        if (h.m_counts.size() <= previous) h.m_counts.resize(previous + 1);
+        h.m_counts[previous] += n;
+        h.m_total += n;
+    }
+    return h;
+}
+
+// ---- ResponseTimes ----
+
+ResponseTimes::ResponseTimes(QObject *parent) : QObject(parent) {
+    m_clock.start();
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(kFlushMs);
+    connect(&m_flushTimer, &QTimer::timeout, this, &ResponseTimes::flush);
+}
+
+ResponseTimes::~ResponseTimes() {
+    flush();
+}
+
+void ResponseTimes::setUser(int userId) {
+    flush();
+    // Whatever did not make it to disk would be credited to the wrong learner.
+    m_questions.clear();
+    m_user = Samples();
+    m_dirty = false;
+
+    m_userId = userId;
+    m_shownId = -1;
+    m_shownAt = -1;
+    m_shownPending = false;
+    m_submittedId = -1;
+    m_submittedAt = -1;
+}
+
+void ResponseTimes::questionShown(int questionId) {
+    m_shownId = questionId;
+    m_shownAt = -1;
+    m_shownPending = questionId > 0;
+}
+
+void ResponseTimes::answered(int questionId) {
+    const qint64 now = m_clock.elapsed();
+    if (questionId == m_shownId && m_shownAt >= 0) {
+        const qint64 think = now - m_shownAt;
+        m_questions[questionId].think.add(think);
+        m_user.think.add(think);
+        markDirty();
+    }
+
+    m_submittedId = questionId;
+    m_submittedAt = now;
+    // A wrong answer leaves the question up: its next try is timed from the
+    // feedback. A right one is replaced through questionShown() first.
+    m_shownAt = -1;
+    m_shownPending = questionId == m_shownId;
+}
+
+void ResponseTimes::frameSwapped() {
+    const qint64 now = m_clock.elapsed();
+    if (m_submittedAt >= 0) {
+        const qint64 latency = now - m_submittedAt;
+        m_questions[m_submittedId].latency.add(latency);
+        m_user.latency.add(latency);
+        m_submittedAt = -1;
+        markDirty();
+    }
+    if (m_shownPending) {
+        m_shownAt = now;
+        m_shownPending = false;
+    }
+}
+
+void ResponseTimes::markDirty() {
+    m_dirty = true;
+    if (!m_flushTimer.isActive()) m_flushTimer.start();
+}
+
+bool ResponseTimes::mergeInto(QSqlDatabase db, const QString &table, const QString &key, int id,
+                              const Samples &s) {
+    Samples merged = s;
+    QSqlQuery q(db);
+    q.prepare(QString("SELECT think, latency FROM %1 WHERE %2 = ?").arg(table, key));
+    q.addBindValue(id);
+    if (!q.exec()) {
+        qWarning() << table << "read failed:" << q.lastError().text();
+        return false;
+    }
+    if (q.next()) {
+        merged.think.merge(TimeHistogram::decode(q.value(0).toByteArray()));
+        merged.latency.merge(TimeHistogram::decode(q.value(1).toByteArray()));
+    }
+
+    QSqlQuery w(db);
+    w.prepare(QString("INSERT OR REPLACE INTO %1(%2, think, latency) VALUES(?, ?, ?)").arg(table, key));
+    w.addBindValue(id);
+    w.addBindValue(merged.think.encode());
+    w.addBindValue(merged.latency.encode());
+    if (!w.exec()) {
+        qWarning() << table << "write failed:" << w.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+void ResponseTimes::flush() {
+    m_flushTimer.stop();
+    if (!m_dirty || m_userId <= 0) return;
+
+    // Read-merge-write under one write lock; other instances merge into the
+    // same rows. On failure the samples stay pending for the next flush.
+    QSqlDatabase db = Database::db();
+    const bool ok = Database::write(db, [&] {
+        for (auto it = m_questions.cbegin(); it != m_questions.cend(); ++it) {
+            if (!mergeInto(db, QStringLiteral("question_timing"), QStringLiteral("question_id"),
+                           it.key(), it.value()))
+                return false;
+        }
+        return mergeInto(db, QStringLiteral("user_timing"), QStringLiteral("user_id"), m_userId, m_user);
+    }, "save response times");
+    if (!ok) return;
+
+    m_questions.clear();
+    m_user = Samples();
+    m_dirty = false;
+}
+
+QVariantMap ResponseTimes::report(QSqlDatabase db) {
+    QVariantMap out;
+    QSqlQuery q(db);
+    if (!q.exec(R"(
+        SELECT t.question_id, qu.quest_id, qu.prompt, t.think, t.latency
+        FROM question_timing t JOIN questions qu ON qu.id = t.question_id
+        ORDER BY t.question_id
+    )")) {
+        qWarning() << "response time report failed:" << q.lastError().text();
+        return out;
+    }
+
+    struct Row {
+        QVariantMap m;
+        qint64 thinkP50 = 0, latencyP90 = 0;
+        bool judged = false;
+    };
+    QVector<Row> rows;
+    QVector<qint64> medians;
+    TimeHistogram allLatency;
+    while (q.next()) {
+        const TimeHistogram think = TimeHistogram::decode(q.value(3).toByteArray());
+        const TimeHistogram latency = TimeHistogram::decode(q.value(4).toByteArray());
+        allLatency.merge(latency);
+
+        Row r;
+        r.m["questionId"] = q.value(0).toInt();
+        r.m["questId"] = q.value(1).toInt();
+        r.m["prompt"] = q.value(2).toString();
+        r.m["think"] = summary(think);
+        r.m["latency"] = summary(latency);
+        r.thinkP50 = think.percentile(50);
+        r.latencyP90 = latency.count() >= quint64(kMinSamples) ? latency.percentile(90) : 0;
+        r.judged = think.count() >= quint64(kMinSamples);
+        if (r.judged) medians.append(r.thinkP50);
+        rows.append(r);
+    }
+
+    // Slow to answer is judged against the other questions: learners and
+    // content differ too much for a fixed limit. Slow to render is not.
+    qint64 typical = 0;
+    if (!medians.isEmpty()) {
+        std::nth_element(medians.begin(), medians.begin() + medians.size() / 2, medians.end());
+        typical = medians.at(medians.size() / 2);
+    }
+
+    QVector<const Row *> slowThink, slowApp;
+    QVariantList questions;
+    for (Row &r : rows) {
+        const bool isSlowThink = r.judged && typical > 0 && r.thinkP50 > kSlowFactor * typical;
+        const bool isSlowApp = r.latencyP90 > kLatencyBudgetMs;
+        r.m["slowThink"] = isSlowThink;
+        r.m["slowApp"] = isSlowApp;
+        questions.append(r.m);
+        if (isSlowThink) slowThink.append(&r);
+        if (isSlowApp) slowApp.append(&r);
+    }
+    std::sort(slowThink.begin(), slowThink.end(), [](const Row *a, const Row *b) { return a->thinkP50 > b->thinkP50; });
+    std::sort(slowApp.begin(), slowApp.end(), [](const Row *a, const Row *b) { return a->latencyP90 > b->latencyP90; });
+
+    QVariantList slowQuestions, slowPaths;
+    for (const Row *r : slowThink) slowQuestions.append(r->m);
+    for (const Row *r : slowApp) slowPaths.append(r->m);
+
+    out["questions"] = questions;
+    out["slowQuestions"] = slowQuestions;
+    out["slowApp"] = slowPaths;
+    out["typicalThinkMs"] = typical;
+    out["latency"] = summary(allLatency);
+    return out;
+}
+
+QVariantMap ResponseTimes::userReport(QSqlDatabase db, int userId) {
+    TimeHistogram think, latency;
+    QSqlQuery q(db);
+    q.prepare("SELECT think, latency FROM user_timing WHERE user_id = ?");
+    q.addBindValue(userId);
+    if (!q.exec()) {
+        qWarning() << "user response times failed:" << q.lastError().text();
+    } else if (q.next()) {
+        think = TimeHistogram::decode(q.value(0).toByteArray());
+        latency = TimeHistogram::decode(q.value(1).toByteArray());
+    }
+
+    QVariantMap out;
+    out["think"] = summary(think);
+    out["latency"] = summary(latency);
+    return out;
+}
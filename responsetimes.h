@@ -0,0 +1,97 @@
+#pragma once
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QTimer>
+#include <QVariantMap>
+#include <QVector>
+
+// Millisecond durations in log-linear buckets, HDR style: exact below
+// 32 ms, then 16 buckets per power of two (at most 1/16 relative error) up
+// to kMaxMs. Longer values land in the last bucket. At most ~300 counters;
+// stored as sparse varint (gap, count) pairs, typically a few dozen bytes.
+class TimeHistogram {
+public:
+    static constexpr int kSubBits = 5;
+    static constexpr qint64 kMaxMs = 60 * 60 * 1000;
+
+    void add(qint64 ms, quint64 n = 1);
+    void merge(const TimeHistogram &other);
+
+    bool isEmpty() const { return m_total == 0; }
+    quint64 count() const { return m_total; }
+    // Upper bound of the bucket holding the p-th percentile (0..100); 0 if empty.
+    qint64 percentile(double p) const;
+    qint64 max() const { return percentile(100); }
+
+    QByteArray encode() const;
+    // An empty or unreadable blob gives an empty histogram.
+    static TimeHistogram decode(const QByteArray &blob);
+
+private:
+    static int bucketOf(qint64 ms);
+    static qint64 lowerBound(int bucket);
+
+    QVector<quint64> m_counts;   // grows to the highest bucket used
+    quint64 m_total = 0;
+};
+
+// How long learners think and how long the app takes to answer them.
+//   think   = question on screen (first frame after it was requested, or
+//             after the feedback to a wrong answer) -> answer submitted
+//   latency = answer submitted -> next frame on screen (the feedback)
+// Samples collect in memory and are merged into question_timing (shared by
+// all cohorts) and user_timing (the learner's shard) in batches.
+class ResponseTimes : public QObject {
+    Q_OBJECT
+public:
+    static constexpr int kFlushMs = 30000;
+    static constexpr int kMinSamples = 5;             // before a question is judged
+    static constexpr double kSlowFactor = 2.0;        // think p50 over the typical question's
+    static constexpr qint64 kLatencyBudgetMs = 100;   // latency p90 over this is a slow app path
+
+    explicit ResponseTimes(QObject *parent = nullptr);
+    ~ResponseTimes() override;
+
+    // Flushes the previous learner's samples and drops any half-timed answer.
+    void setUser(int userId);
+
+    void questionShown(int questionId);   // -1: nothing to answer
+    void answered(int questionId);
+    void frameSwapped();
+
+    void flush();                         // persist pending samples now
+
+    // {questions: [{questionId, questId, prompt, think, latency, slowThink, slowApp}],
+    //  slowQuestions: [...], slowApp: [...], typicalThinkMs, latency}
+    // where think/latency are {samples, p50, p90, p99, max} in ms. The two
+    // slow lists are subsets of questions, slowest first.
+    static QVariantMap report(QSqlDatabase db);
+    // {think, latency} for one learner.
+    static QVariantMap userReport(QSqlDatabase db, int userId);
+
+private:
+    struct Samples {
+        TimeHistogram think, latency;
+    };
+
+    void markDirty();
+    static bool mergeInto(QSqlDatabase db, const QString &table, const QString &key, int id,
+                          const Samples &s);
+
+    int m_userId = -1;
+    QElapsedTimer m_clock;
+
+    int m_shownId = -1;
+    qint64 m_shownAt = -1;                // -1: not on screen yet
+    bool m_shownPending = false;          // start the clock on the next frame
+    int m_submittedId = -1;
+    qint64 m_submittedAt = -1;
+
+    QHash<int, Samples> m_questions;      // pending, by question id
+    Samples m_user;
+    bool m_dirty = false;
+    QTimer m_flushTimer;
+};
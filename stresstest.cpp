@@ -0,0 +1,184 @@
+#include "stresstest.h"
+#include "Database.h"
+#include "analytics.h"
+#include "xpledger.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QVector>
+#include <QDebug>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// The worker's stdout line, in this order.
+struct WorkerReport {
+    qint64 ops = 0, elapsedMs = 0;
+    qint64 transactions = 0, retries = 0, failures = 0, waitMs = 0, maxWaitMs = 0;
+    double minRate = 0, maxRate = 0;   // ops/s over the slowest and fastest window
+
+    bool parse(const QByteArray& line) {
+        const QList<QByteArray> f = line.trimmed().split(' ');
+        if (f.size() != 9) return false;
+        ops = f[0].toLongLong();
+        elapsedMs = f[1].toLongLong();
+        transactions = f[2].toLongLong();
+        retries = f[3].toLongLong();
+        failures = f[4].toLongLong();
+        waitMs = f[5].toLongLong();
+        maxWaitMs = f[6].toLongLong();
+        minRate = f[7].toDouble();
+        maxRate = f[8].toDouble();
+        return true;
+    }
+};
+
+qint64 scalar(const char* sql, int userId) {
+    QSqlQuery q(Database::db());
+    q.prepare(QString::fromLatin1(sql));
+    if (userId > 0) q.addBindValue(userId);
+    if (!q.exec() || !q.next()) {
+        qWarning() << "stress: check failed:" << q.lastError().text();
+        return -1;
+    }
+    return q.value(0).toLongLong();
+}
+
+} // namespace
+
+void StressTest::removeScratchFiles() {
+    for (const QString& base : {Database::dbPath(), Database::archivePath()}) {
+        for (const char* suffix : {"", "-wal", "-shm"}) QFile::remove(base + QLatin1String(suffix));
+    }
+}
+
+int StressTest::run(int workers, int ops) {
+    if (workers <= 0 || ops <= 0) {
+        qCritical() << "stress: need at least one worker and one op";
+        return 1;
+    }
+    const int userId = Database::createUser(Database::db(), QStringLiteral("stress"));
+    if (userId <= 0) return 1;
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert(QStringLiteral("QT_QPA_PLATFORM"), QStringLiteral("offscreen"));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<std::unique_ptr<QProcess>> procs;
+    for (int i = 0; i < workers; ++i) {
+        auto p = std::make_unique<QProcess>();
+        p->setProcessEnvironment(env);
+        p->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        p->start(QCoreApplication::applicationFilePath(),
+                 {QStringLiteral("--stress-worker"), QString::number(ops),
+                  QStringLiteral("--stress-user"), QString::number(userId)});
+        procs.push_back(std::move(p));
+    }
+
+    bool ok = true;
+    WorkerReport sum;
+    double minRate = 0, maxRate = 0;
+    for (int i = 0; i < workers; ++i) {
+        QProcess& p = *procs[i];
+        WorkerReport r;
+        if (!p.waitForFinished(-1) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0
+            || !r.parse(p.readAllStandardOutput())) {
+            qCritical() << "stress: worker" << i << "failed";
+            ok = false;
+            continue;
+        }
+        qInfo().nospace() << "worker " << i << ": " << r.ops << " ops in " << r.elapsedMs << " ms, "
+                          << r.retries << " retries, " << r.failures << " failures, lock wait "
+                          << r.waitMs << " ms (max " << r.maxWaitMs << "), " << qRound(r.minRate)
+                          << "-" << qRound(r.maxRate) << " ops/s";
+        sum.ops += r.ops;
+        sum.transactions += r.transactions;
+        sum.retries += r.retries;
+        sum.failures += r.failures;
+        sum.waitMs += r.waitMs;
+        sum.maxWaitMs = qMax(sum.maxWaitMs, r.maxWaitMs);
+        minRate = i == 0 ? r.minRate : qMin(minRate, r.minRate);
+        maxRate = qMax(maxRate, r.maxRate);
+    }
+    const qint64 elapsed = timer.elapsed();
+
+    // Every op is one attempt (summary and analytics counters included)
+    // and one XP; anything short of that is a lost update.
+    const qint64 expected = qint64(workers) * ops;
+    const struct { const char* what; qint64 got; } checks[] = {
+        {"attempts", scalar("SELECT COUNT(*) FROM attempts WHERE user_id = ?", userId)},
+        {"attempt_summary", scalar("SELECT SUM(attempts) FROM attempt_summary WHERE user_id = ?", userId)},
+        {"question_stats", scalar("SELECT SUM(attempts) FROM question_stats", 0)},
+        {"xp_ledger", scalar("SELECT SUM(amount) FROM xp_ledger WHERE user_id = ?", userId)},
+        {"user_stats", scalar("SELECT total_xp FROM user_stats WHERE user_id = ?", userId)},
+    };
+    for (const auto& c : checks) {
+        if (c.got == expected) continue;
+        qCritical() << "stress:" << c.what << "has" << c.got << "expected" << expected;
+        ok = false;
+    }
+
+    qInfo().nospace() << "stress: " << workers << " processes, " << sum.ops << " ops in " << elapsed
+                      << " ms (" << qRound(sum.ops * 1000.0 / qMax<qint64>(elapsed, 1)) << " ops/s), "
+                      << sum.transactions << " transactions, " << sum.retries << " retries, "
+                      << sum.failures << " failures, worst lock wait " << sum.maxWaitMs
+                      << " ms, per-worker window rate " << qRound(minRate) << "-" << qRound(maxRate)
+                      << " ops/s: " << (ok && sum.failures == 0 ? "OK" : "FAILED");
+    return ok && sum.failures == 0 ? 0 : 1;
+}
+
+int StressTest::worker(int userId, int ops) {
+    QVector<int> questions;
+    {
+        QSqlQuery q(Database::db());
+        if (!q.exec("SELECT id FROM questions")) return 1;
+        while (q.next()) questions.append(q.value(0).toInt());
+    }
+    if (userId <= 0 || questions.isEmpty()) return 1;
+
+    auto* rng = QRandomGenerator::global();
+    QSqlDatabase db = Database::db();
+    QElapsedTimer timer, window;
+    timer.start();
+    window.start();
+    double minRate = 0, maxRate = 0;
+
+    int done = 0;
+    for (; done < ops; ++done) {
+        // What submitAnswer writes: the attempt with its summary and
+        // counters and its XP, in one transaction. Every op earns 1 XP so
+        // the totals can be checked.
+        Analytics::Attempt a;
+        a.userId = userId;
+        a.questionId = questions.at(rng->bounded(int(questions.size())));
+        a.timestamp = Database::now();
+        a.correct = rng->bounded(2) == 1;
+        a.answer = rng->bounded(4);
+        if (!Database::write(db, [&] {
+                return Analytics::recordAttempt(db, a) && XpLedger::appendIn(db, userId, XpLedger::Answer, 1) >= 0;
+            }, "stress attempt"))
+            break;
+
+        if ((done + 1) % kWindowOps == 0) {
+            const double rate = kWindowOps * 1000.0 / qMax<qint64>(window.restart(), 1);
+            minRate = done + 1 == kWindowOps ? rate : qMin(minRate, rate);
+            maxRate = qMax(maxRate, rate);
+        }
+    }
+
+    const Database::Contention c = Database::contention();
+    std::printf("%d %lld %llu %llu %llu %lld %lld %.1f %.1f\n", done, timer.elapsed(),
+                static_cast<unsigned long long>(c.transactions), static_cast<unsigned long long>(c.retries),
+                static_cast<unsigned long long>(c.failures), c.waitMs, c.maxWaitMs, minRate, maxRate);
+    std::fflush(stdout);
+    return done == ops ? 0 : 1;
+}
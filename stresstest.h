@@ -0,0 +1,19 @@
+#pragma once
+
+// Several processes answering questions against one database file at once.
+// Workers record attempts and XP through the same paths as the app; the
+// parent then checks that every write landed. Runs on a scratch database
+// (QStandardPaths test mode), never the learner's own.
+class StressTest {
+public:
+    static constexpr int kOpsPerWorker = 500;
+    static constexpr int kWindowOps = 50;   // throughput is sampled per window
+
+    // Deletes the scratch database; before Database::init, parent only.
+    static void removeScratchFiles();
+    // Starts `workers` copies of this executable, waits, verifies the
+    // totals and prints contention and throughput. Returns an exit code.
+    static int run(int workers, int ops = kOpsPerWorker);
+    // One child: ops answer-equivalent writes for userId, then one stats line on stdout.
+    static int worker(int userId, int ops);
+};
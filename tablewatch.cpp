@@ -0,0 +1,150 @@
+#include "tablewatch.h"
+#include "Database.h"
+#include <QCoreApplication>
+#include <QMetaObject>
+#include <QThread>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <sqlite3.h>
+#include <utility>
+
+namespace {
+
+// One connection per thread (see Database::threadDb), so the open
+// transaction's tables can live in a thread_local.
+thread_local int t_pending = 0;
+
+int tableBit(const char *table) {
+    static const struct { const char *name; int bit; } kMap[] = {
+        {"users", TableWatch::Users},
+        {"quests", TableWatch::Content},
+        {"questions", TableWatch::Content},
+        {"lessons", TableWatch::Content},
+        {"daily_tasks", TableWatch::Content},
+        {"quest_progress", TableWatch::Progress},
+        {"attempts", TableWatch::Attempts},
+        {"xp_ledger", TableWatch::Xp},
+        {"user_stats", TableWatch::Xp},
+        {"leaderboard_agg", TableWatch::Xp},
+    };
+    for (const auto &m : kMap) {
+        if (qstrcmp(m.name, table) == 0) return m.bit;
+    }
+    return TableWatch::Other;
+}
+
+void onUpdate(void *, int, const char *schema, const char *table, sqlite3_int64) {
+    // The archive only ever receives moved rows; temp holds views. In a
+    // cohort shard, users and content live in "shared".
+    if (qstrcmp(schema, "main") == 0 || qstrcmp(schema, "shared") == 0) t_pending |= tableBit(table);
+}
+
+void onRollback(void *) { t_pending = 0; }
+
+} // namespace
+
+TableWatch *TableWatch::s_instance = nullptr;
+
+TableWatch::TableWatch(QObject *parent) : QObject(parent) {
+    m_poll.setInterval(kPollMs);
+    connect(&m_poll, &QTimer::timeout, this, &TableWatch::poll);
+}
+
+TableWatch *TableWatch::instance() {
+    if (!s_instance) {
+        Q_ASSERT(QThread::currentThread() == QCoreApplication::instance()->thread());
+        s_instance = new TableWatch(QCoreApplication::instance());
+    }
+    return s_instance;
+}
+
+bool TableWatch::hooksActive() {
+    return Database::nativeApi();
+}
+
+void TableWatch::install(QSqlDatabase db) {
+    // Database::init() already said why when there is no handle.
+    sqlite3 *h = Database::handle(db);
+    if (!h) return;
+    const bool foreign = QThread::currentThread() != QCoreApplication::instance()->thread();
+    if (!foreign) instance();
+
+    void *ctx = foreign ? h : nullptr;   // any non-null marks a worker connection
+    sqlite3_update_hook(h, onUpdate, nullptr);
+    sqlite3_commit_hook(h, &TableWatch::onCommit, ctx);
+    sqlite3_rollback_hook(h, onRollback, nullptr);
+}
+
+int TableWatch::onCommit(void *foreign) {
+    // Runs inside the commit: no SQL here, just hand the tables over.
+    const int tables = std::exchange(t_pending, 0);
+    if (tables) post(tables, foreign != nullptr);
+    return 0;
+}
+
+void TableWatch::post(int tables, bool foreign) {
+    TableWatch *w = s_instance;
+    if (!w) return;
+
+    (foreign ? w->m_foreign : w->m_own).fetch_or(tables);
+    if (!w->m_flushQueued.exchange(true))
+        QMetaObject::invokeMethod(w, &TableWatch::flush, Qt::QueuedConnection);
+}
+
+void TableWatch::flush() {
+    m_flushQueued = false;
+
+    const int own = m_own.exchange(0);
+    const int foreign = m_foreign.exchange(0);
+    if (own) emit changed(Tables(own), false);
+    if (foreign) emit changed(Tables(foreign), true);
+}
+
+void TableWatch::startPolling(QSqlDatabase db) {
+    m_db = db;
+    m_cohort = Database::currentCohort();
+    m_dataVersion = m_sharedVersion = -1;
+    poll();
+    m_poll.start();
+}
+
+void TableWatch::poll() {
+    // data_version moves for every other connection's commit, our workers'
+    // included. Their hooks reported their own tables, but another process
+    // may have committed in the same interval; only "anything may have
+    // changed" is safe.
+    if (readVersions()) post(kAll, true);
+}
+
+void TableWatch::skipOwnWrites() {
+    // Without hooks the versions are all there is: what moved them up to
+    // now is taken to be the worker that just finished. Another process's
+    // commit in the same interval goes unreported until the next one.
+    if (!hooksActive() && m_poll.isActive()) readVersions();
+}
+
+bool TableWatch::readVersions() {
+    // Versions are per connection: after the main connection reopened on
+    // another cohort they start over, and that alone is no change.
+    const QString cohort = Database::currentCohort();
+    if (cohort != m_cohort) m_dataVersion = m_sharedVersion = -1;
+    m_cohort = cohort;
+
+    auto version = [this](const char *sql, qint64 &last) {
+        QSqlQuery q(m_db);
+        if (!q.exec(QString::fromLatin1(sql)) || !q.next()) {
+            qWarning() << "table watch:" << sql << "failed:" << q.lastError().text();
+            return false;
+        }
+        const qint64 v = q.value(0).toLongLong();
+        const bool moved = last >= 0 && v != last;
+        last = v;
+        return moved;
+    };
+
+    bool moved = version("PRAGMA data_version", m_dataVersion);
+    if (!cohort.isEmpty()) moved = version("PRAGMA shared.data_version", m_sharedVersion) || moved;
+    return moved;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <QObject>
+#include <QSqlDatabase>
+#include <QTimer>
+#include <atomic>
+
+// Which tables changed, as reported by SQLite rather than by the code that
+// wrote them. Each connection gets an update hook that collects the tables
+// touched by its open transaction; the commit hook publishes them and the
+// rollback hook drops them. Commits by any other connection are found by
+// polling PRAGMA data_version on the main connection, for main and (in a
+// cohort) the attached shared file, and reported as everything.
+//
+// Listeners hear at most once per event-loop turn, split by origin: the
+// main-thread connection (the controller's own writes) or anyone else.
+// WITHOUT ROWID tables (attempt_summary, daily_*, sync_*) have no update
+// hook; their writers also touch a rowid table in the same transaction.
+//
+// The hooks need the linked SQLite to be the driver's (Database::nativeApi).
+// Otherwise only the poll reports, and it cannot tell tables apart: every
+// change is kAll and foreign. Writers in this process then mark what they
+// changed themselves (see hooksActive()), and once a worker has finished,
+// skipOwnWrites() keeps its commits from being reported as foreign too.
+class TableWatch : public QObject {
+    Q_OBJECT
+public:
+    enum Table {
+        Users    = 0x1,
+        Content  = 0x2,    // quests, questions, lessons, daily_tasks
+        Progress = 0x4,    // quest_progress
+        Attempts = 0x8,
+        Xp       = 0x10,   // xp_ledger, user_stats
+        Other    = 0x20,
+    };
+    Q_DECLARE_FLAGS(Tables, Table)
+    Q_FLAG(Tables)
+    static constexpr int kAll = 0x3f;
+
+    static constexpr int kPollMs = 2000;
+
+    // Created on the main thread by the first install().
+    static TableWatch *instance();
+    // Hooks one connection; call right after open(), on its own thread.
+    // Does nothing when hooks are not active.
+    static void install(QSqlDatabase db);
+    // Whether commits in this process are reported as they happen.
+    static bool hooksActive();
+
+    void startPolling(QSqlDatabase db);
+    // Without hooks: treat every commit the poll has not seen yet as this
+    // process's own and do not report it. Main thread, after a worker's
+    // writes are done.
+    void skipOwnWrites();
+
+signals:
+    void changed(TableWatch::Tables tables, bool foreign);
+
+private:
+    explicit TableWatch(QObject *parent = nullptr);
+
+    static void post(int tables, bool foreign);   // any thread
+    static int onCommit(void *foreign);
+    void flush();
+    void poll();
+    bool readVersions();   // whether either version moved since the last read
+
+    static TableWatch *s_instance;
+
+    std::atomic<int> m_own{0};
+    std::atomic<int> m_foreign{0};
+    std::atomic<bool> m_flushQueued{false};
+
+    QSqlDatabase m_db;
+    QTimer m_poll;
+    QString m_cohort;                  // layout the versions below belong to
+    qint64 m_dataVersion = -1;         // main
+    qint64 m_sharedVersion = -1;       // shared, when a cohort is open
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(TableWatch::Tables)
@@ -0,0 +1,92 @@
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QtQml/qqmlregistration.h>
+
+// Rows the controller hands to QML, by value. Registered with the
+// CodeLeveling module as value types (and lists of them), so bindings read
+// plain members instead of looking up QVariantMap keys, and building a row
+// costs no per-field boxing or key hashing.
+
+class Question {
+    Q_GADGET
+    QML_VALUE_TYPE(question)
+    Q_PROPERTY(int id MEMBER id FINAL)
+    Q_PROPERTY(QString type MEMBER type FINAL)
+    Q_PROPERTY(QString prompt MEMBER prompt FINAL)
+    Q_PROPERTY(QStringList choices MEMBER choices FINAL)
+    Q_PROPERTY(int xp MEMBER xp FINAL)
+    Q_PROPERTY(bool valid READ isValid FINAL)   // false: the quest is mastered
+public:
+    int id = -1;
+    QString type;
+    QString prompt;
+    QStringList choices;
+    int xp = 0;
+
+    bool isValid() const { return id > 0; }
+};
+
+class QuestSummary {
+    Q_GADGET
+    QML_VALUE_TYPE(questSummary)
+    Q_PROPERTY(int id MEMBER id FINAL)
+    Q_PROPERTY(QString title MEMBER title FINAL)
+    Q_PROPERTY(QString topic MEMBER topic FINAL)
+    Q_PROPERTY(int difficulty MEMBER difficulty FINAL)
+    Q_PROPERTY(QString status MEMBER status FINAL)     // locked, unlocked, completed
+    Q_PROPERTY(int bestScore MEMBER bestScore FINAL)
+    Q_PROPERTY(bool valid READ isValid FINAL)
+public:
+    int id = -1;
+    QString title;
+    QString topic;
+    int difficulty = 1;
+    QString status;
+    int bestScore = 0;
+
+    bool isValid() const { return id > 0; }
+};
+
+class DailyTask {
+    Q_GADGET
+    QML_VALUE_TYPE(dailyTask)
+    Q_PROPERTY(int id MEMBER id FINAL)
+    Q_PROPERTY(QString title MEMBER title FINAL)
+    Q_PROPERTY(int xp MEMBER xp FINAL)
+    Q_PROPERTY(bool done MEMBER done FINAL)
+    Q_PROPERTY(bool manual MEMBER manual FINAL)        // completed by button, not by play
+    Q_PROPERTY(int progress MEMBER progress FINAL)
+    Q_PROPERTY(int target MEMBER target FINAL)
+    Q_PROPERTY(bool valid READ isValid FINAL)
+public:
+    int id = -1;
+    QString title;
+    int xp = 0;
+    bool done = false;
+    bool manual = false;
+    int progress = 0;
+    int target = 1;
+
+    bool isValid() const { return id > 0; }
+};
+
+class LeaderboardEntry {
+    Q_GADGET
+    QML_VALUE_TYPE(leaderboardEntry)
+    Q_PROPERTY(QString username MEMBER username FINAL)
+    Q_PROPERTY(int xp MEMBER xp FINAL)
+    Q_PROPERTY(int level MEMBER level FINAL)
+    Q_PROPERTY(QString lastActive MEMBER lastActive FINAL)   // ISO date, empty if never
+    Q_PROPERTY(double score MEMBER score FINAL)
+    Q_PROPERTY(bool valid READ isValid FINAL)
+public:
+    QString username;
+    int xp = 0;
+    int level = 1;
+    QString lastActive;
+    double score = 0;
+
+    bool isValid() const { return !username.isEmpty(); }
+};
@@ -0,0 +1,158 @@
+#include "xpledger.h"
+#include "Database.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+int XpLedger::levelForXp(int xp) {
+    // Simple leveling: every 200 XP = +1 level
+    return 1 + (xp / 200);
+}
+
+bool XpLedger::readTotal(QSqlDatabase db, int userId, int &total, int &tailRows, qint64 &lastId) {
+    QSqlQuery q(db);
+    q.prepare(R"(
+        SELECT COALESCE(s.total_xp, 0) + COALESCE(SUM(l.amount), 0),
+               COUNT(l.id),
+               MAX(COALESCE(s.ledger_id, 0), COALESCE(MAX(l.id), 0))
+        FROM (SELECT ? AS user_id) u
+        LEFT JOIN xp_snapshots s ON s.user_id = u.user_id
+        LEFT JOIN xp_ledger l ON l.user_id = u.user_id AND l.id > COALESCE(s.ledger_id, 0)
+    )");
+    q.addBindValue(userId);
+    if (!q.exec() || !q.next()) {
+        qWarning() << "xp total failed:" << q.lastError().text();
+        return false;
+    }
+    total = q.value(0).toInt();
+    tailRows = q.value(1).toInt();
+    lastId = q.value(2).toLongLong();
+    return true;
+}
+
+bool XpLedger::writeStats(QSqlDatabase db, int userId, int total, bool touchActive) {
+    QSqlQuery q(db);
+    q.prepare("UPDATE user_stats SET total_xp=?, level=?, last_active=COALESCE(?, last_active) WHERE user_id=?");
+    q.addBindValue(total);
+    q.addBindValue(levelForXp(total));
+    q.addBindValue(touchActive ? QVariant(Database::now()) : QVariant());
+    q.addBindValue(userId);
+    if (!q.exec()) {
+        qWarning() << "user_stats update failed:" << q.lastError().text();
+        return false;
+    }
+    return Database::publishStats(db, userId);
+}
+
+bool XpLedger::writeSnapshot(QSqlDatabase db, int userId, qint64 ledgerId, int total) {
+    QSqlQuery q(db);
+    q.prepare(R"(
+        INSERT INTO xp_snapshots(user_id, ledger_id, total_xp) VALUES(?, ?, ?)
+        ON CONFLICT(user_id) DO UPDATE SET ledger_id=excluded.ledger_id, total_xp=excluded.total_xp
+    )");
+    q.addBindValue(userId);
+    q.addBindValue(ledgerId);
+    q.addBindValue(total);
+    if (!q.exec()) {
+        qWarning() << "xp snapshot failed:" << q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+int XpLedger::append(int userId, Source source, int amount, int ref) {
+    QSqlDatabase db = Database::db();
+
+    // BEGIN IMMEDIATE holds the write lock from the start, so the total read
+    // below already includes every other writer's rows.
+    int total = 0;
+    const bool ok = Database::write(db, [&] {
+        return (total = appendIn(db, userId, source, amount, ref)) >= 0;
+    }, "xp append");
+    return ok ? total : -1;
+}
+
+int XpLedger::appendIn(QSqlDatabase db, int userId, Source source, int amount, int ref) {
+    QSqlQuery ins(db);
+    ins.prepare("INSERT INTO xp_ledger(user_id, source, amount, ref, day) VALUES(?, ?, ?, ?, ?)");
+    ins.addBindValue(userId);
+    ins.addBindValue(int(source));
+    ins.addBindValue(amount);
+    ins.addBindValue(ref > 0 ? QVariant(ref) : QVariant());
+    ins.addBindValue(Database::today());
+    if (!ins.exec()) {
+        qWarning() << "xp append failed:" << ins.lastError().text();
+        return -1;
+    }
+
+    int total = 0, tailRows = 0;
+    qint64 lastId = 0;
+    const bool ok = readTotal(db, userId, total, tailRows, lastId)
+                    && writeStats(db, userId, total)
+                    && (tailRows < kSnapshotEvery || writeSnapshot(db, userId, lastId, total));
+    return ok ? total : -1;
+}
+
+int XpLedger::total(int userId) {
+    int total = 0, tailRows = 0;
+    qint64 lastId = 0;
+    if (!readTotal(Database::db(), userId, total, tailRows, lastId)) return -1;
+    return total;
+}
+
+bool XpLedger::refreshStats(QSqlDatabase db, int userId) {
+    int total = 0, tailRows = 0;
+    qint64 lastId = 0;
+    return readTotal(db, userId, total, tailRows, lastId)
+        && writeStats(db, userId, total, false)
+        && (tailRows < kSnapshotEvery || writeSnapshot(db, userId, lastId, total));
+}
+
+bool XpLedger::rebuildAllStats(QSqlDatabase db) {
+    if (!Database::begin(db)) return false;
+
+    QSqlQuery zero(db);
+    if (!zero.exec("UPDATE user_stats SET total_xp=0, level=1 WHERE user_id NOT IN (SELECT user_id FROM xp_ledger)")
+        || !zero.exec("DELETE FROM xp_snapshots WHERE user_id NOT IN (SELECT user_id FROM xp_ledger)")
+        || !zero.exec(R"(UPDATE leaderboard_agg SET total_xp=0, level=1
+                         WHERE user_id IN (SELECT user_id FROM user_stats)
+                           AND user_id NOT IN (SELECT user_id FROM xp_ledger))")) {
+        qWarning() << zero.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT user_id, id, amount FROM xp_ledger ORDER BY user_id, id")) {
+        qWarning() << q.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    int userId = -1, total = 0;
+    qint64 lastId = 0;
+    auto finishUser = [&] {
+        return userId < 0 || (writeSnapshot(db, userId, lastId, total) && writeStats(db, userId, total, false));
+    };
+
+    bool ok = true;
+    while (ok && q.next()) {
+        const int uid = q.value(0).toInt();
+        if (uid != userId) {
+            ok = finishUser();
+            userId = uid;
+            total = 0;
+        }
+        lastId = q.value(1).toLongLong();
+        total += q.value(2).toInt();
+    }
+    ok = ok && finishUser();
+
+    if (!ok || !db.commit()) {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <QSqlDatabase>
+
+// Append-only XP history.
+// A user's total is their latest snapshot plus the short tail of ledger rows
+// after it; user_stats.total_xp/level are a cache rewritten from that total
+// inside the same transaction as the append, and copied to leaderboard_agg.
+class XpLedger {
+public:
+    enum Source {
+        Legacy = 0,     // total_xp carried over from before the ledger existed
+        Answer = 1,
+        Quest = 2,
+        Daily = 3,
+    };
+
+    // Returns the user's new total, or -1 on failure. ref is the quest or
+    // daily task a Quest or Daily row was earned for (sync merges by it).
+    static int append(int userId, Source source, int amount, int ref = 0);
+    // The same inside the caller's write transaction, on its connection.
+    static int appendIn(QSqlDatabase db, int userId, Source source, int amount, int ref = 0);
+    static int total(int userId);
+    static int levelForXp(int xp);
+
+    // Rewrites the user's cached total after rows were inserted directly
+    // (sync import); call inside the caller's transaction.
+    static bool refreshStats(QSqlDatabase db, int userId);
+
+    // Recomputes snapshots and user_stats for every user of db's cohort in
+    // one pass over the ledger (--rebuild-stats).
+    static bool rebuildAllStats(QSqlDatabase db);
+
+private:
+    static constexpr int kSnapshotEvery = 64;   // max tail length before a new snapshot
+
+    static bool readTotal(QSqlDatabase db, int userId, int &total, int &tailRows, qint64 &lastId);
+    static bool writeStats(QSqlDatabase db, int userId, int total, bool touchActive = true);
+    static bool writeSnapshot(QSqlDatabase db, int userId, qint64 ledgerId, int total);
+};